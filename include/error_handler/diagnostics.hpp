@@ -0,0 +1,104 @@
+#ifndef __DIAGNOSTICS_HPP__
+#define __DIAGNOSTICS_HPP__
+// Structured diagnostics. A phase reports into the DiagnosticBuffer of a
+// file: a report is a record of the kind, the location and the message
+// arguments, and nothing is formatted or written until the buffer is
+// rendered - sorted by location, without duplicates and up to a limit, as
+// text for people or as JSON lines for tools. A buffer belongs to one
+// thread at a time, so reporting takes no lock.
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utils/buffered_writer.hpp>
+#include <utils/source_buffer.hpp>
+
+enum class Severity : std::uint8_t {
+  NOTE,
+  WARNING,
+  ERROR
+};
+
+// What a diagnostic says. Kinds are defined once, statically, by the phase
+// that reports them.
+struct DiagnosticKind {
+  // Stable identifier for tools, e.g. LEX001
+  const char* code;
+  Severity severity;
+  // fmt format of the message; {} stand for the arguments in order
+  const char* format;
+};
+
+struct Diagnostic {
+  const DiagnosticKind* kind{nullptr};
+  std::uint64_t offset{0};
+  // 0 based
+  std::uint32_t line_no{0};
+  std::uint32_t col_no{0};
+  // Bytes of input the diagnostic is about
+  std::uint32_t length{0};
+  // Index of the line text kept for input whose buffer does not outlive
+  // the report; kNoLineText if the text is read from the source
+  std::uint32_t line_text{0};
+  std::array<std::int64_t, 2> args{};
+};
+
+enum class DiagnosticFormat {
+  TEXT,
+  JSON
+};
+
+class DiagnosticBuffer {
+public:
+  static constexpr std::uint32_t kNoLineText{0xffffffffu};
+
+  // Line texts are read from source when rendering; without it they are
+  // only shown where kept with KeepLineText
+  DiagnosticBuffer(const std::string& file_name,
+                   const std::shared_ptr<const SourceBuffer>& source = nullptr);
+  ~DiagnosticBuffer() = default;
+
+  void Report(const DiagnosticKind& kind, const std::uint64_t offset,
+              const std::uint32_t line_no, const std::uint32_t col_no,
+              const std::uint32_t length = 0, const std::int64_t arg0 = 0,
+              const std::int64_t arg1 = 0) {
+    diagnostics_.push_back({&kind, offset, line_no, col_no, length, kNoLineText, {arg0, arg1}});
+    if (kind.severity == Severity::ERROR) { ++num_errors_; }
+  }
+  // Keep the text of the line of the last report
+  void KeepLineText(const std::string_view line);
+
+  const std::string& GetFileName() const { return file_name_; }
+  std::size_t Size() const { return diagnostics_.size(); }
+  bool Empty() const { return diagnostics_.empty(); }
+  std::size_t GetNumErrors() const { return num_errors_; }
+  const std::vector<Diagnostic>& GetDiagnostics() const { return diagnostics_; }
+
+  // Order by location and drop repeated reports of a kind at one location.
+  // A buffer without diagnostics releases its source.
+  void Finish();
+
+  // Write the first max_diagnostics diagnostics and return how many were
+  // written
+  std::size_t Render(const DiagnosticFormat format, const std::size_t max_diagnostics,
+                     BufferedWriter* const out) const;
+
+  // The message of a diagnostic
+  static std::string FormatMessage(const Diagnostic& diagnostic);
+
+private:
+  std::string file_name_;
+  std::shared_ptr<const SourceBuffer> source_;
+  std::vector<Diagnostic> diagnostics_;
+  std::vector<std::string> line_texts_;
+  std::size_t num_errors_{0};
+
+  std::string_view GetLineText(const Diagnostic& diagnostic) const;
+  void RenderText(const Diagnostic& diagnostic, BufferedWriter* const out) const;
+  void RenderJson(const Diagnostic& diagnostic, BufferedWriter* const out) const;
+};
+
+#endif // __DIAGNOSTICS_HPP__
@@ -1,19 +1,24 @@
 #ifndef __ERROR_HANDLER_HPP__
 #define __ERROR_HANDLER_HPP__
 
+#include <memory>
 #include <string>
 #include <utils/file_location.hpp>
+#include <utils/source_buffer.hpp>
 
 class ErrorHandler {
 public:
+  ErrorHandler(const std::string& prefix, const std::shared_ptr<const SourceBuffer>& source);
+  // Without the source, errors must be reported with their location
   ErrorHandler(const std::string& prefix, const std::string& file_name);
   ~ErrorHandler() = default;
 
   void ConsolePrint(const std::size_t buf_idx, const std::string& msg);
+  void ConsolePrint(const FileLocationInfo& file_location_info, const std::string& msg);
 private:
   std::string prefix_;
   std::string file_name_;
-  FileLocation file_location_;
+  std::unique_ptr<FileLocation> file_location_;
 };
 
 #endif // __ERROR_HANDLER_HPP__
@@ -8,11 +8,38 @@
 #include <unordered_map>
 #include <memory>
 
+// Phases of the regex -> DFA construction, in the order they run
+enum DFAConstructionPhase {
+  DFA_PHASE_PARSE = 0,
+  DFA_PHASE_POSITIONS = 1,
+  DFA_PHASE_FIRSTPOS_LASTPOS = 2,
+  DFA_PHASE_FOLLOWPOS = 3,
+  DFA_PHASE_SUBSET_CONSTRUCTION = 4,
+  DFA_PHASE_COUNT = 5
+};
+
+const char* DFAConstructionPhaseName(const DFAConstructionPhase phase);
+
+// Observer notified around every construction phase. Used by profiling tools
+// to time the constructor phase by phase.
+class DFAPhaseListener {
+public:
+  virtual ~DFAPhaseListener() = default;
+
+  virtual void OnPhaseStart(const DFAConstructionPhase phase) = 0;
+  virtual void OnPhaseEnd(const DFAConstructionPhase phase) = 0;
+};
+
 class DFA {
 public:
-  DFA(const std::string& regex);
+  DFA(const std::string& regex, DFAPhaseListener* const listener = nullptr);
   ~DFA();
 
+  // Number of DFA states and number of regex positions (leaf nodes,
+  // including the end marker)
+  int GetNumStates() const { return static_cast<int>(accepting_.size()); }
+  int GetNumPositions() const { return static_cast<int>(nodepos_symbols_.size()); }
+
   // Reset DFA to start state
   void Reset();
 
@@ -26,6 +53,18 @@ public:
   // some symbol from some state
   bool InErrorState() const;
 
+  // Transition table accessors - used by scanners and code generators.
+  // Transitions into states from which no accepting state can be reached are
+  // dropped, so an automaton dies as soon as it can no longer match.
+  int GetStartState() const { return dfa_start_state_; }
+  bool IsAcceptingState(const int state) const {
+    return state >= 0 && accepting_.at(state);
+  }
+  // Returns the state reached from state on symbol, -1 if there is no transition
+  int GetTransition(const int state, const char symbol) const {
+    return transition_table_[state * kNumSymbols + static_cast<unsigned char>(symbol)];
+  }
+
   // Test the input string with the DFA.
   // Return true if the string ends in an accepting state
   // Return false otherwise
@@ -52,6 +91,11 @@ private:
   int dfa_start_state_{-1};
   int current_dfa_state_{-1};
 
+  // Dense form of dfa_ - kNumSymbols entries per state, -1 for no transition
+  static constexpr int kNumSymbols{256};
+  std::vector<int> transition_table_{};
+  std::vector<bool> accepting_{};
+
   std::shared_ptr<Node> regex_tree_{nullptr};
 
   std::shared_ptr<Node> MakeRegexTree(const std::string& regex);
@@ -71,6 +115,10 @@ private:
 
   void SubsetConstruction();
 
+  // Build the dense transition table, dropping transitions into states that
+  // cannot reach an accepting state
+  void BuildTransitionTable();
+
   /** Utilities **/
 
   // Draw regex tree - utility
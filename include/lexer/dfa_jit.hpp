@@ -0,0 +1,48 @@
+#ifndef __DFA_JIT_HPP__
+#define __DFA_JIT_HPP__
+// Compile token automatons to native x86-64 code.
+// Every DFA state becomes a directly coded block that loads the next byte and
+// branches to the successor state with compare-and-branch sequences, or with a
+// jump table for states with many outgoing ranges. The automatons are run one
+// after another from the same start position and the generated function
+// returns the longest match, with the index of the winning automaton encoded
+// in the upper half of the return value.
+
+#include <cstddef>
+#include <vector>
+#include <lexer/dfa.hpp>
+
+class DFAJit {
+public:
+  // automatons are in precedence order - on equal match lengths the automaton
+  // that comes first wins
+  explicit DFAJit(const std::vector<const DFA*>& automatons);
+  ~DFAJit();
+
+  DFAJit(const DFAJit&) = delete;
+  DFAJit& operator=(const DFAJit&) = delete;
+
+  // Is native code generation available on this platform ?
+  static bool IsSupported();
+
+  bool IsCompiled() const { return match_fn_ != nullptr; }
+
+  std::size_t GetCodeSize() const { return code_size_; }
+
+  // Find the longest non-empty prefix of [begin, end) accepted by any of the
+  // automatons. Returns false if there is none. With scan_length, also tells
+  // how far from begin the automatons read, matching or not. Throws
+  // std::length_error for input of 4 GiB or more.
+  bool Match(const char* const begin, const char* const end,
+             int* const automaton_idx, std::size_t* const length,
+             std::size_t* const scan_length = nullptr) const;
+
+private:
+  using MatchFn = long (*)(const char* begin, const char* end, long* scan_length);
+
+  void* code_{nullptr};
+  std::size_t code_size_{0};
+  MatchFn match_fn_{nullptr};
+};
+
+#endif // __DFA_JIT_HPP__
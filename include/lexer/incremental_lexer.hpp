@@ -0,0 +1,96 @@
+#ifndef __INCREMENTAL_LEXER_HPP__
+#define __INCREMENTAL_LEXER_HPP__
+// Declare an incremental lexer - keeps the tokens of a text up to date
+// through edits. An edit is re-lexed from the first token whose scan read
+// the edited bytes, until a new token starts where an old token after the
+// edit started, in the same lexer modes. From there on the old tokens are
+// kept, and the shift of their offsets is applied lazily - only the tokens
+// between this edit and the last one are touched. The work is in proportion
+// to the edit, the lookahead of the tokens around it and the distance from
+// the previous edit.
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <lexer/lexer.hpp>
+#include <lexer/lexer_spec.hpp>
+#include <lexer/token.hpp>
+#include <utils/source_buffer.hpp>
+
+// Replace removed bytes at offset with inserted
+struct TextEdit {
+  std::size_t offset{0};
+  std::size_t removed{0};
+  std::string inserted;
+};
+
+// The tokens an edit replaced
+struct RelexResult {
+  std::size_t first_token{0};
+  std::size_t num_removed{0};
+  std::size_t num_inserted{0};
+};
+
+class IncrementalLexer {
+public:
+  explicit IncrementalLexer(const std::shared_ptr<const LexerSpec>& spec);
+
+  // Lex text from scratch; name is used for diagnostics only
+  void SetText(const std::string& name, const std::string& text);
+  // Apply edit to the text and re-lex around it. Throws std::out_of_range
+  // if the edit is not within the text.
+  RelexResult ApplyEdit(const TextEdit& edit);
+
+  std::string_view GetText() const { return source_->View(); }
+  // Applies the pending shift of the offsets to all the tokens
+  const TokenBuffer& GetTokens();
+  std::size_t GetNumTokens() const { return tokens_.Size(); }
+  Token GetToken(const std::size_t i) const;
+
+private:
+  Lexer lexer_;
+  // Edited in place; the lexer reads it
+  std::shared_ptr<SourceBuffer> source_;
+  TokenBuffer tokens_;
+
+  // Per token - the end of the input read to match it, the furthest end
+  // read by it or any token before it, and the lexer modes it starts in
+  std::vector<std::size_t> lookahead_ends_;
+  std::vector<std::size_t> max_lookahead_ends_;
+  std::vector<std::uint32_t> mode_stack_ids_;
+
+  // The offsets and lookahead ends of the tokens from shift_first_ on are
+  // stored shift_ bytes before where they are
+  std::size_t shift_first_{0};
+  std::int64_t shift_{0};
+
+  // Mode stacks are interned so that tokens compare them by id
+  std::vector<std::vector<int>> mode_stacks_;
+  std::map<std::vector<int>, std::uint32_t> mode_stack_ids_by_stack_;
+
+  // Stored values may wrap around below zero; the shift brings them back
+  std::size_t Shifted(const std::size_t i, const std::size_t position) const {
+    return i < shift_first_ ? position : static_cast<std::size_t>(position + shift_);
+  }
+  std::uint32_t GetOffset(const std::size_t i) const {
+    return i < shift_first_ ? tokens_.Offset(i) :
+                              static_cast<std::uint32_t>(tokens_.Offset(i) + shift_);
+  }
+  std::size_t GetLookaheadEnd(const std::size_t i) const {
+    return Shifted(i, lookahead_ends_[i]);
+  }
+  std::size_t GetMaxLookaheadEnd(const std::size_t i) const {
+    return Shifted(i, max_lookahead_ends_[i]);
+  }
+
+  std::uint32_t InternModeStack(const std::vector<int>& mode_stack);
+  // Apply the pending shift up to first, or take it back down to first
+  void MoveShift(const std::size_t first);
+  // Recompute the maxima from first until they match the old ones
+  void UpdateMaxLookaheadEnds(const std::size_t first);
+};
+
+#endif // __INCREMENTAL_LEXER_HPP__
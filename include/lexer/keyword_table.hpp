@@ -0,0 +1,38 @@
+#ifndef __KEYWORD_TABLE_HPP__
+#define __KEYWORD_TABLE_HPP__
+// Keyword table - a perfect hash of keywords that ignores case. The hash
+// seed is searched for when the table is built so that no two keywords share
+// a slot; a lookup is one hash and one compare.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class KeywordTable {
+public:
+  struct Keyword {
+    std::string text;
+    int value{-1};
+  };
+
+  KeywordTable() = default;
+  // Throws std::invalid_argument if two keywords are equal ignoring case
+  explicit KeywordTable(const std::vector<Keyword>& keywords);
+
+  bool Empty() const { return slots_.empty(); }
+  // Value of the keyword equal to text ignoring case, -1 if there is none
+  int Find(const std::string_view text) const;
+
+private:
+  // Keywords folded to lower case; empty slots have value -1
+  std::vector<Keyword> slots_;
+  std::uint32_t seed_{0};
+  std::size_t min_length_{0};
+  std::size_t max_length_{0};
+
+  static std::uint32_t Hash(const std::string_view text, const std::uint32_t seed);
+};
+
+#endif // __KEYWORD_TABLE_HPP__
@@ -1,59 +1,293 @@
 #ifndef __LEXER_HPP__
 #define __LEXER_HPP__
 // Declare a Lexer class
+#include <array>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <lexer/dfa.hpp>
-#include <error_handler/error_handler.hpp>
+#include <lexer/dfa_jit.hpp>
+#include <lexer/lexer_spec.hpp>
+#include <lexer/literals.hpp>
+#include <lexer/symbol_tables.hpp>
+#include <lexer/token_kinds.hpp>
+#include <lexer/token.hpp>
+#include <lexer/token_cache.hpp>
+#include <lexer/token_file.hpp>
+#include <error_handler/diagnostics.hpp>
 #include <utils/file_location.hpp>
+#include <utils/input_stream.hpp>
+#include <utils/phase_timer.hpp>
+#include <utils/source_buffer.hpp>
 #include <unordered_map>
 #include <unordered_set>
 
+// The location is kept as a buffer offset; Lexer::GetFileLocationInfo
+// resolves it when it is needed
 struct Lexeme {
   std::string lexeme;
-  std::string token;
-  FileLocationInfo file_location_info;
+  TokenKind token{kInvalidTokenKind};
+  std::uint32_t offset{0};
+};
+
+// What RunLexerOn did
+struct LexerRunSummary {
+  std::uint64_t num_bytes{0};
+  // Tokens written to the output
+  std::size_t num_tokens{0};
+  std::size_t num_errors{0};
+  // The tokens came from the token cache
+  bool cached{false};
+  // The errors found, sorted by location; not yet rendered
+  std::shared_ptr<DiagnosticBuffer> diagnostics;
+  // Opening and mapping the input and looking it up in the token cache;
+  // streams are read while lexing
+  PhaseTime read_time;
+  // Lexing runs alongside writing when pipelined
+  PhaseTime lex_time;
+  PhaseTime write_time;
+  // Tokens of each kind, including whitespace and comments; unmatched input
+  // and bad literals are counted in num_errors
+  std::vector<std::size_t> kind_counts;
 };
 
 class Lexer {
 public:
+  // Shares the cached spec of lexer_definition_file
   Lexer(const std::string& lexer_definition_file);
+  Lexer(const std::shared_ptr<const LexerSpec>& spec);
   ~Lexer();
 
-  void RunLexerOn(const std::string& input_file);
+  // Lex input_file ("-" for standard input) to <input_file>.cclex
+  LexerRunSummary RunLexerOn(const std::string& input_file);
+
+  // Scan with automatons compiled to native code. Falls back to the table
+  // driven automatons when native code generation is unavailable.
+  void EnableJit(const bool enable);
+  bool IsJitEnabled() const { return jit_enabled_; }
+
+  // Look keywords up in a perfect hash after a match instead of running the
+  // keyword automatons. On by default.
+  void EnableKeywordLookup(const bool enable);
+  bool IsKeywordLookupEnabled() const { return keyword_lookup_; }
+
+  // Also write the tokens of RunLexerOn to a binary <input_file>.cctok
+  void EnableTokenFile(const bool enable) { token_file_ = enable; }
+
+  // Lex on a thread of its own in RunLexerOn, handing token batches to the
+  // output writer as they fill. Streamed input is not pipelined.
+  void EnablePipeline(const bool enable) { pipeline_ = enable; }
+
+  // Look the tokens of RunLexerOn up in cache before lexing, and store them
+  // there after. The cache may be shared by lexers on several threads;
+  // nullptr turns caching off. Streamed input is not cached.
+  void SetTokenCache(const std::shared_ptr<TokenCache>& cache) { token_cache_ = cache; }
+
+  // Intern the lexemes of identifiers and type names, integers and strings
+  // into tables, and give each token its symbol id. Strings are interned by
+  // their decoded characters.
+  // The tables may be shared by lexers on several threads; nullptr turns
+  // interning off.
+  void SetSymbolTables(const std::shared_ptr<SymbolTables>& tables) { symbol_tables_ = tables; }
+
+  const TokenKindTable& GetTokenKinds() const { return token_kinds_; }
+  const std::shared_ptr<const LexerSpec>& GetSpec() const { return spec_; }
 
   // Lexer as a file processing machine
   void Reset();
   void SetInputFile(const std::string& input_file);
+  void SetInput(const std::shared_ptr<const SourceBuffer>& source);
+  // Lex fd as a stream read in chunks. Memory is bounded by the longest
+  // lexeme rather than the input size. Token offsets are relative to the
+  // buffered window and token texts are valid until the next token.
+  // Streams are matched by the table driven automatons, which tell when a
+  // lexeme may continue past the window.
+  void SetInputStream(const int fd, const std::string& name,
+                      const std::size_t chunk_size = InputStream::kChunkSize);
   // return true if the end of file is not reached
+  bool GetNextToken(Token* const token);
+  // Lex the rest of the input file; not for streamed input
+  void Tokenize(TokenBuffer* const tokens);
+  // Replace the tokens with up to max_tokens next tokens and return their
+  // number, 0 at the end of input. A buffer reused across calls does not
+  // allocate. A batch of streamed input ends where the window would move,
+  // so its tokens stay valid until the next batch.
+  std::size_t NextBatch(TokenBuffer* const tokens, const std::size_t max_tokens);
+  // View of the lexeme in the input buffer; valid until the next input file
+  std::string_view GetTokenText(const Token& token) const;
+  // Offset of the token from the start of the input
+  std::uint64_t GetTokenPosition(const Token& token) const;
+
+  // Current lexer mode and the number of modes entered and not yet left
+  int GetMode() const {
+    return mode_stack_.empty() ? LexerSpec::kInitialMode : mode_stack_.back();
+  }
+  std::size_t GetModeDepth() const { return mode_stack_.size(); }
+  const std::vector<int>& GetModeStack() const { return mode_stack_; }
+
+  // Track how far ahead of each token of the input file the scanner looks.
+  // Lookahead is not known for native code or for runs cut short by the
+  // memo of failed runs, so both are off while tracking.
+  void EnableLookaheadTracking(const bool enable) { track_lookahead_ = enable; }
+  // End of the input the scanner read to match the last token; past the
+  // end of the input if it hit the end
+  std::size_t GetLookaheadEnd() const { return lookahead_end_; }
+  // Continue lexing the input file at offset in the modes of mode_stack
+  void Seek(const std::size_t offset, const std::vector<int>& mode_stack);
+  // The input buffer was spliced in place; lex on from Seek without
+  // setting the input again
+  void InputEdited();
+
+  // Like GetNextToken but copies the lexeme
   bool GetNextLexeme(Lexeme* const lexeme);
+  // Line and column of an offset in the input file; not for streamed input
+  FileLocationInfo GetFileLocationInfo(const std::uint32_t offset) const;
 
 private:
-  std::string lexer_definition_file_;
-  std::vector<std::pair<std::string, std::string>> token_regex_precedence_;
-  std::unordered_set<std::string> keyword_tokens_;
-  std::unordered_set<std::string> symbol_tokens_;
-  std::unordered_map<std::string, std::shared_ptr<DFA>> automatons_;
-  std::unordered_map<std::string, ErrorHandler> error_handlers_;
-  std::unordered_map<std::string, FileLocation> file_locations_;
+  std::shared_ptr<const LexerSpec> spec_;
+  const TokenKindTable& token_kinds_;
+  // Kinds the lexer treats specially
+  TokenKind ws_kind_{kInvalidTokenKind};
+  TokenKind comment_line_kind_{kInvalidTokenKind};
+  TokenKind comment_block_start_kind_{kInvalidTokenKind};
+  TokenKind comment_block_end_kind_{kInvalidTokenKind};
+  TokenKind string_kind_{kInvalidTokenKind};
+  TokenKind integer_kind_{kInvalidTokenKind};
+  // The symbol table of each kind; nullptr for kinds without symbols
+  std::vector<SymbolTable SymbolTables::*> symbol_tables_of_kind_;
+  // The spec's automatons of each mode in precedence order
+  struct ModeAutomatons {
+    std::vector<std::size_t> rules;
+    std::vector<const DFA*> automatons;
+    // Offsets of the automatons' states in the spec
+    std::vector<std::size_t> state_offsets;
+    const DFAJit* jit{nullptr};
+    // Bytes on which some automaton leaves its start state
+    std::array<bool, 256> start_bytes{};
+  };
+  std::vector<ModeAutomatons> modes_;
+  bool jit_requested_{false};
+  bool jit_enabled_{false};
+  bool keyword_lookup_{true};
+  bool track_lookahead_{false};
+  bool token_file_{false};
+  bool pipeline_{false};
+  std::shared_ptr<TokenCache> token_cache_;
+  std::shared_ptr<SymbolTables> symbol_tables_;
 
   // Lexer state
-  std::string input_file_;
-  std::string input_file_buffer_;
-  int lexeme_ptr_;
+  std::shared_ptr<const SourceBuffer> source_;
+  std::unique_ptr<FileLocation> file_location_;
+  std::unique_ptr<InputStream> stream_;
+  // Into source_, or into the window of stream_
+  std::size_t lexeme_ptr_{0};
+  // Modes entered by PUSH rules and not yet left
+  std::vector<int> mode_stack_;
+  std::size_t lookahead_end_{0};
+
+  // Scratch state of the automatons while matching a lexeme
+  std::vector<int> automaton_states_;
+  std::vector<std::size_t> active_automatons_;
+  std::vector<long> last_accept_ptrs_;
+  std::vector<std::size_t> scan_end_ptrs_;
+
+  // Memo of (automaton state, buffer position) pairs known not to lead to an
+  // accepting state - keeps maximal munch linear in the input size. Only
+  // runs that failed are held, and only while a lexeme may still reach them.
+  struct FailedRuns {
+    // Buffer position of states[0]
+    std::size_t begin{0};
+    // The state that failed at each position from begin, -1 for none
+    std::vector<int> states;
+    // Further (position << 32 | state) pairs that failed where states
+    // holds another state
+    std::unordered_set<std::uint64_t> more;
+  };
+  // Indexed by rule
+  std::vector<FailedRuns> failed_runs_;
+
+
+  // Position of a token and of the line it is on
+  struct InputPosition {
+    std::uint64_t offset{0};
+    std::size_t line_no{0};
+    std::uint64_t line_start{0};
+  };
+
+  // Output state of RunLexerOn
+  struct RunOutput;
+  // Write the tokens of a batch to the output of RunLexerOn
+  void WriteBatch(const TokenBuffer& batch, RunOutput* const output) const;
+  // Lex on another thread while writing
+  void RunPipeline(RunOutput* const output);
+  // NextBatch of kBatchSize tokens, adding its time to lex_time
+  std::size_t TimedNextBatch(TokenBuffer* const tokens, PhaseTime* const lex_time);
+
+  std::string_view GetInputView() const;
+  // Hold a token just matched in buffer to the rules for literals. A bad
+  // literal becomes an invalid token whose symbol is its LiteralError.
+  // False if a string runs into the end of a buffer that is not the end of
+  // the input.
+  bool CheckLiteral(const std::string_view buffer, const bool at_end, Token* const token);
+  // Length of the run of input from start that no rule matches. The run
+  // goes on to the next byte that could start a token and at which a rule
+  // does match, or that starts a string. With reached_end, tells if the run
+  // may go on past the buffer instead.
+  std::size_t ErrorRunLength(const char* const buffer, const std::size_t buflen,
+                             const std::size_t start, bool* const reached_end);
+  // Intern the lexemes of the tokens from first on
+  void InternSymbols(TokenBuffer* const tokens, const std::size_t first) const;
+  // With symbol_tables_ locked; decoded is scratch space for strings
+  SymbolId InternSymbol(const Token& token, const std::string_view input,
+                        std::string* const decoded) const;
+  // Report a diagnostic at position to the output of RunLexerOn
+  void ReportDiagnostic(const DiagnosticKind& kind, const InputPosition& position,
+                        const std::size_t length, RunOutput* const output) const;
+
+  // Match the token at lexeme_ptr_ of the input file
+  Token ScanSourceToken();
+  // Without may_refill, returns false where the window would have to move
+  bool GetNextStreamToken(Token* const token, const bool may_refill = true);
+  // Release the window before the current lexeme and read more input
+  bool RefillStream();
+
+  // Pick the automatons and native code of each mode
+  void BuildModes();
 
+  // The keyword rule matching the lexeme of rule, if it takes precedence
+  int LookupKeyword(const int rule, const char* const lexeme, const std::size_t length) const;
+  // Apply the mode action of a matched rule; returns its token kind
+  TokenKind AcceptRule(const int rule);
 
-  void ConstructAutomatons();
+  bool IsFailedState(const int mode, const std::size_t automaton_idx, const int state,
+                     const std::size_t buffer_ptr) const {
+    const FailedRuns& failed{failed_runs_[modes_[mode].rules[automaton_idx]]};
+    // Wraps around for positions before begin
+    const std::size_t i{buffer_ptr - failed.begin};
+    if (i < failed.states.size() && failed.states[i] == state) { return true; }
+    return !failed.more.empty() &&
+           failed.more.count((std::uint64_t{buffer_ptr} << 32) | static_cast<std::uint32_t>(state));
+  }
 
-  // Lexeme matcher - Returns the next position to process
-  int GetLexemeAt(const std::string& buffer, const std::size_t lexeme_ptr,
-		  std::string* const lexeme, std::string* const token);
+  // Memoize the states visited after the last accepting state by automatons
+  // of the mode that ran for long without accepting
+  void RecordFailedRuns(const int mode, const char* const buffer, const std::size_t lexeme_ptr);
+  void ClearFailedRuns();
 
-  // lex file readers
-  std::vector<std::pair<std::string, std::string>> GetTokenRegex();
-  std::unordered_set<std::string> GetKeywords();
-  std::unordered_set<std::string> GetSymbols();
+  // Lexeme matcher - Returns the length of the longest match at lexeme_ptr
+  // by a rule of the current mode, 0 and kNoRule if no rule matches.
+  // buffer[buflen] must be SourceBuffer::kSentinel.
+  static constexpr int kNoRule{-1};
+  std::size_t MatchAt(const char* const buffer, const std::size_t buflen,
+                      const std::size_t lexeme_ptr, int* const rule);
+  // reached_end, if given, tells if the scan ran into the end of the buffer,
+  // i.e. if more input could make the match longer
+  std::size_t MatchAtTable(const char* const buffer, const std::size_t buflen,
+                           const std::size_t lexeme_ptr, int* const rule,
+                           bool* const reached_end);
+  std::size_t MatchAtJit(const char* const buffer, const std::size_t buflen,
+                         const std::size_t lexeme_ptr, int* const rule);
 };
 
 #endif // __LEXER_HPP__
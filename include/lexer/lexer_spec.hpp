@@ -0,0 +1,163 @@
+#ifndef __LEXER_SPEC_HPP__
+#define __LEXER_SPEC_HPP__
+// Declare the lexer specification - the parsed lexer definition file with
+// its compiled token automatons. A LexerSpec is immutable once loaded and is
+// shared read-only by any number of Lexer instances.
+//
+// Rules belong to lexer modes, like flex start conditions. A rule prefixed
+// with <MODE> only matches in that mode; other rules match in the initial
+// mode. A rule may switch modes once it matches,
+//   COMMENT_BLOCK_START : {\(\*} PUSH COMMENT
+//   <COMMENT> COMMENT_BLOCK_END : {\*\)} POP
+// Each mode only runs the automatons of its own rules.
+//
+// Keyword rules can be left out of the automatons a mode runs. The lexer
+// then looks the text of every match up in a perfect hash of the keywords
+// instead, which relies on every keyword also matching as an identifier.
+// A mode with a keyword that no other rule of the mode matches keeps its
+// keyword rules in its automatons.
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+#include <lexer/dfa.hpp>
+#include <lexer/dfa_jit.hpp>
+#include <lexer/keyword_table.hpp>
+#include <lexer/token_kinds.hpp>
+#include <utils/byte_scan.hpp>
+#include <utils/phase_timer.hpp>
+
+enum class ModeAction {
+  NONE,
+  PUSH,
+  POP
+};
+
+struct TokenRule {
+  std::string token;
+  std::string regex;
+  std::string mode;
+  ModeAction action{ModeAction::NONE};
+  // Mode entered by a PUSH
+  std::string push_mode;
+};
+
+// The sections of a lexer definition file
+struct LexerDefinition {
+  // Rules in precedence order
+  std::vector<TokenRule> rules;
+  std::unordered_set<std::string> keywords;
+  std::unordered_set<std::string> symbols;
+};
+
+// Read a lexer definition file in a single pass
+LexerDefinition ReadLexerDefinition(const std::string& lexer_definition_file);
+
+class LexerSpec {
+public:
+  static constexpr int kInitialMode{0};
+  // Version of how the lexer turns input into tokens under a spec, e.g. how
+  // unmatched input is split into error tokens. Bump it whenever the tokens
+  // of some input change, so stored tokens are not reused.
+  static constexpr std::uint32_t kScannerVersion{1};
+  static const std::string kInitialModeName;
+
+  // Load a lexer definition file. Specs are cached by file name, so loading
+  // the same file again returns the spec already built.
+  static std::shared_ptr<const LexerSpec> Load(const std::string& lexer_definition_file);
+
+  // Build a spec that is not cached
+  explicit LexerSpec(const std::string& lexer_definition_file);
+  ~LexerSpec() = default;
+
+  LexerSpec(const LexerSpec&) = delete;
+  LexerSpec& operator=(const LexerSpec&) = delete;
+
+  const std::string& GetFileName() const { return lexer_definition_file_; }
+  const LexerDefinition& GetDefinition() const { return definition_; }
+  // Hash of the definition file; changes whenever the tokens may
+  std::uint64_t GetFingerprint() const { return fingerprint_; }
+  // Token kinds are numbered by first appearance of the token name
+  const TokenKindTable& GetTokenKinds() const { return token_kinds_; }
+
+  // Rules in definition order
+  std::size_t GetNumRules() const { return rules_.size(); }
+  const TokenRule& GetRule(const std::size_t rule) const { return definition_.rules[rule]; }
+  TokenKind GetRuleKind(const std::size_t rule) const { return rules_[rule].kind; }
+  // Mode entered by a PUSH rule
+  int GetRulePushMode(const std::size_t rule) const { return rules_[rule].push_mode; }
+  const DFA& GetAutomaton(const std::size_t rule) const { return *rules_[rule].automaton; }
+
+  // States of all rule automatons numbered consecutively; the automaton of a
+  // rule has the states GetStateOffset(rule) onwards
+  std::size_t GetStateOffset(const std::size_t rule) const { return rules_[rule].state_offset; }
+  std::size_t GetNumStates() const { return num_states_; }
+  // Time taken to build the rule automatons
+  const PhaseTime& GetAutomatonTime() const { return automaton_time_; }
+  // Bytes on which a state loops back to itself, e.g. the body of a comment
+  // or a string; nullptr if the state does not loop or the bytes are not a
+  // ByteClass. States are numbered as by GetStateOffset.
+  const ByteClass* GetSelfLoop(const std::size_t state) const { return self_loops_[state].get(); }
+
+  // Modes; kInitialMode first
+  std::size_t GetNumModes() const { return modes_.size(); }
+  const std::string& GetModeName(const int mode) const { return modes_[mode].name; }
+  // Rules of a mode in precedence order; without the keyword rules for
+  // keyword lookup
+  const std::vector<std::size_t>& GetModeRules(const int mode,
+                                               const bool keyword_lookup = false) const {
+    return keyword_lookup ? modes_[mode].scan_rules : modes_[mode].rules;
+  }
+  // The keyword rule of the mode matching all of text, -1 if there is none
+  int FindKeyword(const int mode, const std::string_view text) const;
+
+  // The automatons of GetModeRules(mode, keyword_lookup) compiled to native
+  // code on first use; the match index is a position in those rules.
+  // nullptr if native code generation is unavailable.
+  const DFAJit* GetJit(const int mode, const bool keyword_lookup = false) const;
+
+private:
+  struct CompiledRule {
+    TokenKind kind{kInvalidTokenKind};
+    int push_mode{kInitialMode};
+    std::unique_ptr<DFA> automaton;
+    std::size_t state_offset{0};
+  };
+
+  struct ModeJit {
+    std::unique_ptr<std::once_flag> once{new std::once_flag};
+    std::unique_ptr<DFAJit> jit;
+  };
+
+  struct Mode {
+    std::string name;
+    std::vector<std::size_t> rules;
+    // rules less the keyword rules, which are in keywords
+    std::vector<std::size_t> scan_rules;
+    KeywordTable keywords;
+    // Indexed by keyword lookup
+    ModeJit jits[2];
+  };
+
+  std::string lexer_definition_file_;
+  std::uint64_t fingerprint_{0};
+  LexerDefinition definition_;
+  TokenKindTable token_kinds_;
+  std::vector<CompiledRule> rules_;
+  std::size_t num_states_{0};
+  PhaseTime automaton_time_;
+  std::vector<std::unique_ptr<const ByteClass>> self_loops_;
+  // jit is filled in lazily by the const GetJit
+  mutable std::vector<Mode> modes_;
+
+  int FindMode(const std::string& name) const;
+  void ConstructModes();
+  void ConstructAutomatons();
+  void ConstructKeywordTables();
+};
+
+#endif // __LEXER_SPEC_HPP__
@@ -0,0 +1,47 @@
+#ifndef __LITERALS_HPP__
+#define __LITERALS_HPP__
+// Scan and decode COOL literals by the rules of the language, which regular
+// expressions do not capture: a string ends at its closing quote, at an
+// unescaped newline or at the end of input, holds at most kMaxStringLength
+// characters once its escapes are decoded and no null characters; an
+// integer must fit 32 bits.
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+constexpr std::size_t kMaxStringLength{1024};
+
+enum class LiteralError : std::uint8_t {
+  NONE,
+  INTEGER_TOO_LARGE,
+  STRING_TOO_LONG,
+  STRING_NULL,
+  STRING_ESCAPED_NULL,
+  STRING_UNTERMINATED,
+  STRING_EOF
+};
+
+// The message of the COOL reference lexer
+const char* GetLiteralErrorMessage(const LiteralError error);
+
+struct StringLiteral {
+  // Bytes from the opening quote to the closing quote, the unescaped
+  // newline or the end of input, inclusive
+  std::size_t length{0};
+  // The first rule the string breaks
+  LiteralError error{LiteralError::NONE};
+  // The string runs to the end of input
+  bool reached_end{false};
+};
+
+// Scan the string whose opening quote is input[0]. The characters are
+// decoded into decoded, if given: \b \t \n \f stand for their control
+// characters and a backslash makes any other character, newline included,
+// stand for itself.
+StringLiteral ScanStringLiteral(const std::string_view input, std::string* const decoded = nullptr);
+
+// Value of a string of decimal digits; false if it does not fit 32 bits
+bool DecodeInteger(const std::string_view digits, std::int32_t* const value);
+
+#endif // __LITERALS_HPP__
@@ -1,6 +1,7 @@
 #ifndef __REGEX_TREE_NODES_HPP__
 #define __REGEX_TREE_NODES_HPP__
 
+#include <string>
 #include <unordered_set>
 #include <cassert>
 #include <set>
@@ -0,0 +1,22 @@
+#ifndef __SYMBOL_TABLES_HPP__
+#define __SYMBOL_TABLES_HPP__
+// The symbol tables of a compilation, as in the COOL reference compiler:
+// identifiers and type names, integer literals and string literals. Lexers
+// that share the tables intern under the mutex. Literals are interned
+// decoded - strings by their characters, integers also by their value.
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <utils/symbol_table.hpp>
+
+struct SymbolTables {
+  SymbolTable idtable;
+  SymbolTable inttable;
+  SymbolTable stringtable;
+  // Value of each inttable symbol
+  std::vector<std::int32_t> integers;
+  std::mutex mutex;
+};
+
+#endif // __SYMBOL_TABLES_HPP__
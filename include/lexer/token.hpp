@@ -0,0 +1,102 @@
+#ifndef __TOKEN_HPP__
+#define __TOKEN_HPP__
+// Declare the zero-copy token representation and the token buffer
+// A token refers to its lexeme by offset and length into the source buffer;
+// the lexeme text is a view into that buffer and is never copied.
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include <lexer/token_kinds.hpp>
+#include <utils/symbol_table.hpp>
+
+// kind is kInvalidTokenKind for input that no token matches and for bad
+// literals. symbol is the interned lexeme of identifiers and literals when
+// the lexer has symbol tables; for a bad literal it is its LiteralError;
+// else kNoSymbol.
+struct Token {
+  TokenKind kind{kInvalidTokenKind};
+  std::uint32_t offset{0};
+  std::uint32_t length{0};
+  SymbolId symbol{kNoSymbol};
+};
+
+// Replace num_removed elements of a column from first with replacement. The
+// elements after them only move if the count changes.
+template <typename T>
+void ReplaceRange(std::vector<T>* const column, const std::size_t first,
+                  const std::size_t num_removed, const std::vector<T>& replacement) {
+  assert (first + num_removed <= column->size());
+  const std::size_t num_common{std::min(num_removed, replacement.size())};
+  std::copy(replacement.begin(), replacement.begin() + num_common, column->begin() + first);
+  if (num_removed > num_common) {
+    column->erase(column->begin() + first + num_common, column->begin() + first + num_removed);
+  } else {
+    column->insert(column->begin() + first + num_common,
+                   replacement.begin() + num_common, replacement.end());
+  }
+}
+
+// Struct-of-arrays token storage. Tokens are appended in source order and
+// stay valid as long as the source buffer they refer to.
+class TokenBuffer {
+public:
+  TokenBuffer() = default;
+  ~TokenBuffer() = default;
+
+  void Reserve(const std::size_t num_tokens);
+  void Clear();
+
+  std::size_t Size() const { return kinds_.size(); }
+  bool Empty() const { return kinds_.empty(); }
+
+  // Replace num_removed tokens from first with the tokens of replacement
+  void Replace(const std::size_t first, const std::size_t num_removed,
+               const TokenBuffer& replacement);
+  // Move the tokens in [first, last) by delta bytes
+  void ShiftOffsets(const std::size_t first, const std::size_t last, const std::int64_t delta);
+
+  // Append the tokens of other
+  void Append(const TokenBuffer& other);
+  // Replace the tokens with num_tokens tokens read from the given columns;
+  // without symbols they are kNoSymbol
+  void Assign(const TokenKind* const kinds, const std::uint32_t* const offsets,
+              const std::uint32_t* const lengths, const std::size_t num_tokens,
+              const SymbolId* const symbols = nullptr);
+
+  void Append(const Token& token) {
+    kinds_.push_back(token.kind);
+    offsets_.push_back(token.offset);
+    lengths_.push_back(token.length);
+    symbols_.push_back(token.symbol);
+  }
+  void SetSymbol(const std::size_t i, const SymbolId symbol) { symbols_[i] = symbol; }
+
+  TokenKind Kind(const std::size_t i) const { return kinds_[i]; }
+  std::uint32_t Offset(const std::size_t i) const { return offsets_[i]; }
+  std::uint32_t Length(const std::size_t i) const { return lengths_[i]; }
+  SymbolId Symbol(const std::size_t i) const { return symbols_[i]; }
+  Token Get(const std::size_t i) const {
+    return {kinds_[i], offsets_[i], lengths_[i], symbols_[i]};
+  }
+
+  std::string_view Text(const std::size_t i, const std::string_view source) const {
+    return source.substr(offsets_[i], lengths_[i]);
+  }
+
+  // Column access for phases that scan one attribute of every token
+  const std::vector<TokenKind>& Kinds() const { return kinds_; }
+  const std::vector<std::uint32_t>& Offsets() const { return offsets_; }
+  const std::vector<std::uint32_t>& Lengths() const { return lengths_; }
+  const std::vector<SymbolId>& Symbols() const { return symbols_; }
+
+private:
+  std::vector<TokenKind> kinds_;
+  std::vector<std::uint32_t> offsets_;
+  std::vector<std::uint32_t> lengths_;
+  std::vector<SymbolId> symbols_;
+};
+
+#endif // __TOKEN_HPP__
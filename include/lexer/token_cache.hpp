@@ -0,0 +1,101 @@
+#ifndef __TOKEN_CACHE_HPP__
+#define __TOKEN_CACHE_HPP__
+// Declare the on-disk token cache - the tokens of a file stored under a hash
+// of the file contents and of the lexer spec, so an unchanged file is not
+// lexed again by a later run. An entry holds the token columns as they are
+// in memory, in the byte order of the machine that wrote it:
+//
+//   header   TokenCacheHeader
+//   kinds    int16 per token, padded to 4 bytes
+//   offsets  uint32 per token
+//   lengths  uint32 per token
+//   errors   uint32 per token - the LiteralError of an invalid token,
+//            kNoSymbol otherwise; symbol ids are not kept
+//
+// The cache is kept under a size limit by evicting the least recently used
+// entries; a hit refreshes the modification time of its entry, which is
+// what eviction orders by. Entries are written under a temporary name and
+// renamed into place, so concurrent runs see whole entries or none. The
+// header keeps the length of the contents and a second hash of them, so a
+// collision of the hash that names the entry is a miss.
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <lexer/lexer_spec.hpp>
+#include <lexer/token.hpp>
+
+// Identifies the tokens of some contents under a spec
+struct TokenCacheKey {
+  // Names the entry
+  std::uint64_t hash{0};
+  // Hash of the same bytes with another seed
+  std::uint64_t check{0};
+  std::uint64_t source_bytes{0};
+};
+
+struct TokenCacheHeader {
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t num_tokens;
+  std::uint32_t reserved;
+  // Key of the entry; the hash is checked against its file name
+  std::uint64_t hash;
+  std::uint64_t check;
+  std::uint64_t source_bytes;
+};
+
+struct TokenCacheStats {
+  std::uint64_t hits{0};
+  std::uint64_t misses{0};
+  std::uint64_t stores{0};
+  std::uint64_t evictions{0};
+};
+
+class TokenCache {
+public:
+  static constexpr char kMagic[4]{'C', 'C', 'T', 'C'};
+  static constexpr std::uint32_t kVersion{4};
+  static constexpr std::uint64_t kDefaultMaxBytes{256ull << 20};
+
+  // Create directory if needed
+  TokenCache(const std::string& directory, const std::uint64_t max_bytes = kDefaultMaxBytes);
+  ~TokenCache() = default;
+
+  TokenCache(const TokenCache&) = delete;
+  TokenCache& operator=(const TokenCache&) = delete;
+
+  // Key of contents lexed with spec by this version of the lexer
+  static TokenCacheKey Key(const LexerSpec& spec, const std::string_view contents);
+
+  // Fill tokens from the entry of key; false on a miss. Safe to call from
+  // several threads.
+  bool Load(const TokenCacheKey& key, TokenBuffer* const tokens);
+  // Store tokens under key, then evict entries over the size limit
+  void Store(const TokenCacheKey& key, const TokenBuffer& tokens);
+
+  TokenCacheStats GetStats() const;
+  const std::string& GetDirectory() const { return directory_; }
+
+private:
+  std::string directory_;
+  std::uint64_t max_bytes_;
+  // Bytes of the entries as of the last scan plus those stored since
+  std::atomic<std::uint64_t> num_bytes_{0};
+  // One eviction scan at a time
+  std::mutex evict_mutex_;
+
+  std::atomic<std::uint64_t> hits_{0};
+  std::atomic<std::uint64_t> misses_{0};
+  std::atomic<std::uint64_t> stores_{0};
+  std::atomic<std::uint64_t> evictions_{0};
+
+  std::string EntryPath(const std::uint64_t hash) const;
+  // Sum the entry sizes and, if over the limit, remove the least recently
+  // used entries until under it
+  void Evict();
+};
+
+#endif // __TOKEN_CACHE_HPP__
@@ -0,0 +1,115 @@
+#ifndef __TOKEN_FILE_HPP__
+#define __TOKEN_FILE_HPP__
+// Declare the writer and the reader of the binary token file format (.cctok)
+//
+// A .cctok file holds the tokens a later phase consumes - the tokens of the
+// .cclex output - so it can be read without lexing or parsing text again.
+// All integers are little endian. The file is laid out as
+//
+//   header      TokenFileHeader
+//   kind names  per kind: has-lexeme byte, varint length, name bytes
+//   kinds       uint16 per token
+//   offsets     varint delta of each token's buffer offset from the previous
+//   lines       varint delta of each token's 0 based line from the previous
+//   lexemes     varint string index per token whose kind has a lexeme
+//   strings     per string: varint length, bytes - every lexeme once
+//
+// Lexemes are the raw token text; string tokens keep their quotes.
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <lexer/token_kinds.hpp>
+#include <utils/source_buffer.hpp>
+
+struct TokenFileHeader {
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t num_kinds;
+  std::uint32_t num_tokens;
+  std::uint32_t num_strings;
+  // Byte offsets of the sections from the start of the file
+  std::uint32_t kind_names_offset;
+  std::uint32_t kinds_offset;
+  std::uint32_t offsets_offset;
+  std::uint32_t lines_offset;
+  std::uint32_t lexemes_offset;
+  std::uint32_t strings_offset;
+  std::uint32_t file_size;
+};
+
+// A decoded token of a token file
+struct TokenRecord {
+  TokenKind kind{kInvalidTokenKind};
+  std::uint32_t offset{0};
+  std::uint32_t line_no{0};
+  // Empty for kinds without a lexeme; a view into the token file
+  std::string_view lexeme;
+};
+
+class TokenFileWriter {
+public:
+  static constexpr char kMagic[4]{'C', 'C', 'T', 'K'};
+  static constexpr std::uint32_t kVersion{1};
+
+  TokenFileWriter(const TokenKindTable& token_kinds);
+  ~TokenFileWriter() = default;
+
+  // Tokens are appended in source order. text is interned by view and must
+  // stay valid until Write.
+  void Append(const TokenKind kind, const std::uint32_t offset,
+              const std::uint32_t line_no, const std::string_view text);
+
+  void Write(const std::string& file_name) const;
+
+private:
+  const TokenKindTable& token_kinds_;
+  std::uint32_t num_tokens_{0};
+  std::uint32_t last_offset_{0};
+  std::uint32_t last_line_no_{0};
+
+  std::string kinds_;
+  std::string offsets_;
+  std::string lines_;
+  std::string lexemes_;
+  std::unordered_map<std::string_view, std::uint32_t> string_ids_;
+  std::vector<std::string_view> strings_;
+};
+
+class TokenFileReader {
+public:
+  // Throws std::runtime_error when the file is not a valid token file
+  TokenFileReader(const std::string& file_name);
+  ~TokenFileReader() = default;
+
+  std::size_t GetNumTokens() const { return header_.num_tokens; }
+  std::size_t GetNumKinds() const { return kind_names_.size(); }
+  std::string_view GetKindName(const TokenKind kind) const { return kind_names_[kind]; }
+  bool KindHasLexeme(const TokenKind kind) const { return kind_has_lexeme_[kind]; }
+
+  // Decode the tokens in order; false after the last token
+  bool Next(TokenRecord* const record);
+  void Rewind();
+
+private:
+  std::shared_ptr<const SourceBuffer> file_;
+  TokenFileHeader header_;
+  std::vector<std::string_view> kind_names_;
+  std::vector<bool> kind_has_lexeme_;
+  std::vector<std::string_view> strings_;
+
+  // Cursor state
+  std::uint32_t next_token_{0};
+  std::size_t offsets_ptr_{0};
+  std::size_t lines_ptr_{0};
+  std::size_t lexemes_ptr_{0};
+  TokenRecord last_record_;
+
+  // Decode a varint at *ptr, which must lie before end
+  std::uint32_t ReadVarint(std::size_t* const ptr, const std::size_t end) const;
+};
+
+#endif // __TOKEN_FILE_HPP__
@@ -0,0 +1,49 @@
+#ifndef __TOKEN_KINDS_HPP__
+#define __TOKEN_KINDS_HPP__
+// Token kinds - dense integer ids for the tokens of a lexer definition.
+// Ids are assigned in precedence order, i.e. in the order the token
+// definitions appear in the lexer definition file.
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using TokenKind = std::int16_t;
+constexpr TokenKind kInvalidTokenKind{-1};
+
+struct TokenKindInfo {
+  std::string name;
+  // Lower case name as written to the lexer output
+  std::string lower_name;
+  bool is_keyword{false};
+  bool is_symbol{false};
+};
+
+class TokenKindTable {
+public:
+  TokenKindTable() = default;
+  TokenKindTable(const std::vector<std::string>& token_names,
+                 const std::unordered_set<std::string>& keywords,
+                 const std::unordered_set<std::string>& symbols);
+
+  std::size_t Size() const { return kinds_.size(); }
+
+  const TokenKindInfo& Get(const TokenKind kind) const { return kinds_[kind]; }
+
+  // Kind of a token name; kInvalidTokenKind if there is no such token
+  TokenKind Find(const std::string& name) const;
+
+  // Keywords and symbols are fully described by their kind; every other
+  // token carries its lexeme
+  bool HasLexeme(const TokenKind kind) const {
+    return !kinds_[kind].is_keyword && !kinds_[kind].is_symbol;
+  }
+
+private:
+  std::vector<TokenKindInfo> kinds_;
+  std::unordered_map<std::string, TokenKind> kind_by_name_;
+};
+
+#endif // __TOKEN_KINDS_HPP__
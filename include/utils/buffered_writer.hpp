@@ -0,0 +1,47 @@
+#ifndef __BUFFERED_WRITER_HPP__
+#define __BUFFERED_WRITER_HPP__
+// An output sink that collects writes in a fixed size buffer and hands
+// them to the file descriptor a buffer at a time
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+class BufferedWriter {
+public:
+  static constexpr std::size_t kBufferSize{1 << 16};
+
+  // Create or truncate file_name. A file that cannot be opened is reported
+  // and the writes are dropped.
+  BufferedWriter(const std::string& file_name);
+  // Write to an open file descriptor, which the writer does not close
+  BufferedWriter(const int fd);
+  ~BufferedWriter();
+
+  BufferedWriter(const BufferedWriter&) = delete;
+  BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+  bool IsOpen() const { return fd_ >= 0; }
+
+  void Write(const std::string_view text);
+  void Write(const char c) {
+    if (used_ == kBufferSize) { Flush(); }
+    buffer_[used_++] = c;
+  }
+  // Decimal representation of n
+  void WriteNumber(const std::uint64_t n);
+
+  void Flush();
+
+private:
+  std::string file_name_;
+  int fd_{-1};
+  bool owns_fd_{false};
+  std::unique_ptr<char[]> buffer_;
+  std::size_t used_{0};
+
+  void WriteAll(const char* data, std::size_t length);
+};
+
+#endif // __BUFFERED_WRITER_HPP__
@@ -0,0 +1,48 @@
+#ifndef __BYTE_SCAN_HPP__
+#define __BYTE_SCAN_HPP__
+// Vectorized byte scanning kernels
+// Each kernel uses SIMD instructions when the target supports them and
+// falls back to a portable scalar loop otherwise.
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Append the offset of every occurrence of byte in buffer
+void FindAllBytes(const std::string_view buffer, const char byte,
+                  std::vector<std::uint32_t>* const offsets);
+
+// A set of bytes given as a few ranges less a few holes - the shape of the
+// character classes of lexer regexes, e.g. [^\(\*]|[W-S] is
+// {9-13, 32-126} less {'(', '*'}
+struct ByteClass {
+  static constexpr std::size_t kMaxRanges{3};
+  static constexpr std::size_t kMaxHoles{4};
+
+  // lo .. lo + width
+  struct Range {
+    unsigned char lo{0};
+    unsigned char width{0};
+  };
+
+  Range ranges[kMaxRanges];
+  std::size_t num_ranges{0};
+  // Bytes inside the ranges that are not in the class
+  unsigned char holes[kMaxHoles]{};
+  std::size_t num_holes{0};
+
+  // Describe the bytes b with members[b] set. Returns false if the set
+  // needs more ranges or holes than a ByteClass holds.
+  static bool FromMembers(const bool (&members)[256], ByteClass* const byte_class);
+
+  bool Contains(const unsigned char byte) const;
+};
+
+// Position of the first byte at or after pos that is not in byte_class,
+// buffer.length() if there is none. Whitespace runs, comment bodies and
+// string bodies are skipped this way.
+std::size_t SkipByteClass(const std::string_view buffer, std::size_t pos,
+                          const ByteClass& byte_class);
+
+#endif // __BYTE_SCAN_HPP__
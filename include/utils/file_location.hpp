@@ -1,8 +1,14 @@
 #ifndef __FILE_COL_NO_HPP__
 #define __FILE_COL_NO_HPP__
+// Resolve buffer offsets to lines and columns
+// The line index is built on the first query, so offsets that are never
+// reported cost nothing.
 
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <string>
+#include <utils/source_buffer.hpp>
 
 struct FileLocationInfo {
   std::string file_name;
@@ -15,15 +21,24 @@ struct FileLocationInfo {
 class FileLocation {
 public:
 
-  FileLocation(const std::string& filename);
+  FileLocation(const std::shared_ptr<const SourceBuffer>& source);
   ~FileLocation() = default;
 
+  // 0 based line number of buf_idx
+  std::size_t GetLineNo(const std::size_t buf_idx);
+
+  // Line, column and the text of the line - for diagnostics
   FileLocationInfo GetFileLocationInfo(const std::size_t buf_idx);
 
+  // Offsets of the newline characters in the buffer
+  const std::vector<std::uint32_t>& GetNewlineOffsets();
+
 private:
-  std::string file_name_;
-  std::vector<std::string> file_lines_;
-  std::vector<std::size_t> line_start_indices_;
+  std::shared_ptr<const SourceBuffer> source_;
+  bool indexed_{false};
+  std::vector<std::uint32_t> newline_offsets_;
+
+  void BuildIndex();
 };
 
 #endif // __FILE_COL_NO_HPP__
@@ -0,0 +1,11 @@
+#ifndef __HASH_HPP__
+#define __HASH_HPP__
+// Fast 64 bit hash of a byte string (MurmurHash64A). Reads 8 bytes per step;
+// not for hash tables fed by an adversary.
+
+#include <cstdint>
+#include <string_view>
+
+std::uint64_t HashBytes(const std::string_view bytes, const std::uint64_t seed = 0);
+
+#endif // __HASH_HPP__
@@ -0,0 +1,50 @@
+#ifndef __INPUT_STREAM_HPP__
+#define __INPUT_STREAM_HPP__
+// A window over an input read in chunks from a file descriptor
+// Works with pipes and stdin. Bytes before the position the reader keeps
+// from are released on every refill, so memory is bounded by the longest
+// span the reader holds on to (e.g. a lexeme) plus a chunk, not by the
+// size of the input.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class InputStream {
+public:
+  static constexpr std::size_t kChunkSize{1 << 16};
+
+  // The stream does not close fd
+  InputStream(const int fd, const std::string& file_name,
+              const std::size_t chunk_size = kChunkSize);
+  ~InputStream() = default;
+
+  InputStream(const InputStream&) = delete;
+  InputStream& operator=(const InputStream&) = delete;
+
+  const std::string& GetFileName() const { return file_name_; }
+
+  // The window holds the input bytes [GetBase(), GetBase() + size()).
+  // data()[size()] is SourceBuffer::kSentinel.
+  const char* data() const { return buffer_.data(); }
+  std::size_t size() const { return size_; }
+  std::uint64_t GetBase() const { return base_; }
+
+  // Is all of the input in the window ?
+  bool AtEnd() const { return at_end_; }
+
+  // Release the bytes before the absolute position keep_from and read more
+  // input. Returns false if there was no more input.
+  bool Refill(const std::uint64_t keep_from);
+
+private:
+  int fd_;
+  std::string file_name_;
+  std::size_t chunk_size_;
+  std::vector<char> buffer_;
+  std::size_t size_{0};
+  std::uint64_t base_{0};
+  bool at_end_{false};
+};
+
+#endif // __INPUT_STREAM_HPP__
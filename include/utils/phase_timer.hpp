@@ -0,0 +1,48 @@
+#ifndef __PHASE_TIMER_HPP__
+#define __PHASE_TIMER_HPP__
+// Wall and CPU time of phases of work, and resource usage of the process.
+// A timer reads two clocks when it starts and two when it stops, so phases
+// are timed per batch or per file rather than per token.
+
+#include <cstdint>
+
+struct PhaseTime {
+  std::uint64_t wall_ns{0};
+  // CPU time of the thread that did the work
+  std::uint64_t cpu_ns{0};
+
+  PhaseTime& operator+=(const PhaseTime& other) {
+    wall_ns += other.wall_ns;
+    cpu_ns += other.cpu_ns;
+    return *this;
+  }
+};
+
+// Adds the time from construction to destruction to total
+class ScopedPhaseTimer {
+public:
+  ScopedPhaseTimer(PhaseTime* const total);
+  ~ScopedPhaseTimer();
+
+  ScopedPhaseTimer(const ScopedPhaseTimer&) = delete;
+  ScopedPhaseTimer& operator=(const ScopedPhaseTimer&) = delete;
+
+private:
+  PhaseTime* total_;
+  std::uint64_t wall_start_ns_;
+  std::uint64_t cpu_start_ns_;
+};
+
+std::uint64_t GetWallNanos();
+std::uint64_t GetThreadCpuNanos();
+
+struct ProcessUsage {
+  // CPU time of all the threads so far
+  std::uint64_t user_ns{0};
+  std::uint64_t system_ns{0};
+  std::uint64_t peak_rss_bytes{0};
+};
+
+ProcessUsage GetProcessUsage();
+
+#endif // __PHASE_TIMER_HPP__
@@ -0,0 +1,64 @@
+#ifndef __SOURCE_BUFFER_HPP__
+#define __SOURCE_BUFFER_HPP__
+// A source file loaded once and shared, read-only, by every component that
+// needs its contents (lexer, file locations, error handlers).
+// Regular files are memory mapped; pipes and other streams are read once.
+// The contents are always followed by a kSentinel character, so scanners can
+// look one character past the end without a bounds check.
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class SourceBuffer {
+public:
+  static constexpr char kSentinel{'\0'};
+
+  // Load a file. Throws std::runtime_error if it cannot be opened or read.
+  static std::shared_ptr<const SourceBuffer> FromFile(const std::string& file_name);
+
+  // Wrap in-memory contents; file_name is used for diagnostics only
+  static std::shared_ptr<const SourceBuffer> FromString(const std::string& file_name,
+                                                        const std::string_view contents);
+  // In-memory contents that the owner changes in place with Splice
+  static std::shared_ptr<SourceBuffer> FromStringEditable(const std::string& file_name,
+                                                          const std::string_view contents);
+
+  ~SourceBuffer();
+
+  SourceBuffer(const SourceBuffer&) = delete;
+  SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+  const std::string& GetFileName() const { return file_name_; }
+
+  // data()[size()] is kSentinel
+  const char* data() const { return data_; }
+  std::size_t size() const { return size_; }
+  std::string_view View() const { return {data_, size_}; }
+
+  // Replace removed bytes at offset with inserted. Moves only the bytes
+  // after the edit, but may move the contents: data() and views taken
+  // before are invalid. Not for mapped files.
+  void Splice(const std::size_t offset, const std::size_t removed,
+              const std::string_view inserted);
+
+private:
+  SourceBuffer() = default;
+
+  // Memory map a regular file of the given size; false if that is not possible
+  bool Map(const int fd, const std::size_t size);
+  // 0, or the errno of the read that failed
+  int ReadAll(const int fd);
+
+  std::string file_name_;
+  const char* data_{nullptr};
+  std::size_t size_{0};
+
+  // Either a mapping or an owned copy backs data_
+  void* mapping_{nullptr};
+  std::size_t mapping_size_{0};
+  std::vector<char> contents_;
+};
+
+#endif // __SOURCE_BUFFER_HPP__
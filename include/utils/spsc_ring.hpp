@@ -0,0 +1,85 @@
+#ifndef __SPSC_RING_HPP__
+#define __SPSC_RING_HPP__
+// Bounded lock-free ring buffer for one producer thread and one consumer
+// thread. Push blocks while the ring is full, which holds a fast producer
+// back; Pop blocks while it is empty. Either side may Close the ring: Pop
+// then drains what is left and returns false, and Push drops its value and
+// returns false.
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+template <typename T>
+class SpscRing {
+public:
+  // capacity is rounded up to a power of two
+  explicit SpscRing(const std::size_t capacity) {
+    std::size_t size{1};
+    while (size < capacity) { size *= 2; }
+    slots_.resize(size);
+    mask_ = size - 1;
+  }
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  std::size_t Capacity() const { return slots_.size(); }
+
+  // Producer side
+  bool TryPush(T* const value) {
+    const std::size_t tail{tail_.load(std::memory_order_relaxed)};
+    if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+      return false;
+    }
+    slots_[tail & mask_] = std::move(*value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool Push(T value) {
+    while (!TryPush(&value)) {
+      if (IsClosed()) { return false; }
+      std::this_thread::yield();
+    }
+    return true;
+  }
+
+  // Consumer side
+  bool TryPop(T* const value) {
+    assert (value);
+    const std::size_t head{head_.load(std::memory_order_relaxed)};
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    *value = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool Pop(T* const value) {
+    while (!TryPop(value)) {
+      // Values pushed before the ring was closed are still delivered
+      if (IsClosed()) { return TryPop(value); }
+      std::this_thread::yield();
+    }
+    return true;
+  }
+
+  void Close() { closed_.store(true, std::memory_order_release); }
+  bool IsClosed() const { return closed_.load(std::memory_order_acquire); }
+
+private:
+  std::vector<T> slots_;
+  std::size_t mask_{0};
+  // Written by the consumer and the producer respectively; kept on separate
+  // cache lines so the two threads do not contend for one
+  alignas(64) std::atomic<std::size_t> head_{0};
+  alignas(64) std::atomic<std::size_t> tail_{0};
+  alignas(64) std::atomic<bool> closed_{false};
+};
+
+#endif // __SPSC_RING_HPP__
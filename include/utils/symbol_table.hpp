@@ -0,0 +1,55 @@
+#ifndef __SYMBOL_TABLE_HPP__
+#define __SYMBOL_TABLE_HPP__
+// Interned strings. Each distinct string is copied once into an arena and
+// named by a 32 bit id, so that equal strings have equal ids and compare as
+// integers. Ids are handed out consecutively from 0 and, like the views Get
+// returns, stay valid for the life of the table. Lookups probe an open
+// addressing table of ids. Not thread safe.
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+using SymbolId = std::uint32_t;
+constexpr SymbolId kNoSymbol{0xffffffffu};
+
+class SymbolTable {
+public:
+  SymbolTable() = default;
+  ~SymbolTable() = default;
+
+  SymbolTable(const SymbolTable&) = delete;
+  SymbolTable& operator=(const SymbolTable&) = delete;
+
+  // Id of text, interning it if it is new
+  SymbolId Intern(const std::string_view text);
+  // Id of text, kNoSymbol if it has not been interned
+  SymbolId Find(const std::string_view text) const;
+
+  std::string_view Get(const SymbolId id) const { return symbols_[id]; }
+  std::size_t Size() const { return symbols_.size(); }
+  // Bytes of the arena blocks
+  std::size_t GetArenaBytes() const { return arena_bytes_; }
+
+private:
+  static constexpr std::size_t kArenaBlockSize{1 << 16};
+
+  std::vector<std::unique_ptr<char[]>> arena_;
+  char* block_{nullptr};
+  std::size_t block_left_{0};
+  std::size_t arena_bytes_{0};
+
+  std::vector<std::string_view> symbols_;
+  // Kept so that growing the table does not hash the symbols again
+  std::vector<std::uint64_t> hashes_;
+  // Ids by hash; kNoSymbol in empty slots. The size is a power of two.
+  std::vector<SymbolId> slots_;
+
+  // Slot of text or the empty slot where it belongs
+  std::size_t Probe(const std::string_view text, const std::uint64_t hash) const;
+  const char* Copy(const std::string_view text);
+  void Grow();
+};
+
+#endif // __SYMBOL_TABLE_HPP__
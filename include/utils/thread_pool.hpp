@@ -0,0 +1,43 @@
+#ifndef __THREAD_POOL_HPP__
+#define __THREAD_POOL_HPP__
+// Work-stealing thread pool for a fixed set of independent jobs. Jobs are
+// dealt round robin to the workers' queues; a worker takes its own jobs
+// from the back and steals from the front of the other queues once its own
+// queue is empty, so workers that draw short jobs help out the others.
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class WorkStealingPool {
+public:
+  // 0 threads means one per hardware thread
+  explicit WorkStealingPool(const std::size_t num_threads);
+
+  std::size_t GetNumThreads() const { return num_threads_; }
+
+  // Run job(worker, i) for every i < num_jobs and wait for all of them.
+  // worker < GetNumThreads() identifies the thread, so per thread state can
+  // be kept in a vector. The first exception a job throws is rethrown once
+  // all workers are done.
+  void Run(const std::size_t num_jobs,
+           const std::function<void(std::size_t worker, std::size_t job)>& job);
+
+private:
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<std::size_t> jobs;
+  };
+
+  std::size_t num_threads_{1};
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+
+  // Next job for worker, from its own queue or stolen; false when all
+  // queues are empty
+  bool TakeJob(const std::size_t worker, std::size_t* const job);
+};
+
+#endif // __THREAD_POOL_HPP__
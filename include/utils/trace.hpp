@@ -0,0 +1,79 @@
+#ifndef __TRACE_HPP__
+#define __TRACE_HPP__
+// Tracing for hot paths. The CC_TRACE and CC_DEBUG macros log through spdlog
+// only when their level is both compiled in and enabled at run time, and
+// evaluate their arguments only then. A disabled level compiled in costs a
+// load and a branch; one compiled out costs nothing.
+//
+// CCTRACE_LEVEL is the lowest level compiled in (SPDLOG_LEVEL_TRACE = 0,
+// SPDLOG_LEVEL_DEBUG = 1, ...). Debug messages are compiled in by default,
+// per-lexeme and per-symbol trace messages are not.
+
+#include <atomic>
+#include <chrono>
+#include <spdlog/spdlog.h>
+
+#if !defined(CCTRACE_LEVEL)
+#define CCTRACE_LEVEL SPDLOG_LEVEL_DEBUG
+#endif
+
+class Trace {
+public:
+  // Enable levels from level on, here and in spdlog
+  static void SetLevel(const spdlog::level::level_enum level);
+
+  static bool IsEnabled(const spdlog::level::level_enum level) {
+    return __builtin_expect(level >= level_.load(std::memory_order_relaxed), 0);
+  }
+
+private:
+  static std::atomic<int> level_;
+};
+
+// Logs its time from construction to destruction when debug is enabled
+class TraceSpan {
+public:
+  TraceSpan(const char* const name) {
+    if (Trace::IsEnabled(spdlog::level::debug)) { Begin(name); }
+  }
+  ~TraceSpan() {
+    if (name_) { End(); }
+  }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+  const char* name_{nullptr};
+  std::chrono::steady_clock::time_point start_;
+
+  void Begin(const char* const name);
+  void End();
+};
+
+#define CCTRACE_LOG(level, ...)                 \
+  do {                                          \
+    if (Trace::IsEnabled(level)) {              \
+      spdlog::log(level, __VA_ARGS__);          \
+    }                                           \
+  } while (false)
+
+#define CCTRACE_CONCAT_(a, b) a##b
+#define CCTRACE_CONCAT(a, b) CCTRACE_CONCAT_(a, b)
+
+#if CCTRACE_LEVEL <= SPDLOG_LEVEL_TRACE
+#define CC_TRACE(...) CCTRACE_LOG(spdlog::level::trace, __VA_ARGS__)
+#else
+#define CC_TRACE(...) static_cast<void>(0)
+#endif
+
+#if CCTRACE_LEVEL <= SPDLOG_LEVEL_DEBUG
+#define CC_DEBUG(...) CCTRACE_LOG(spdlog::level::debug, __VA_ARGS__)
+// Trace the rest of the enclosing scope as name
+#define CC_TRACE_SPAN(name) const TraceSpan CCTRACE_CONCAT(trace_span_, __LINE__){name}
+#else
+#define CC_DEBUG(...) static_cast<void>(0)
+#define CC_TRACE_SPAN(name) static_cast<void>(0)
+#endif
+
+#endif // __TRACE_HPP__
@@ -1,44 +1,438 @@
 // Main function for the cool compiler
 #include <CLI/CLI11.hpp>
 #include "spdlog/spdlog.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <new>
+#include <system_error>
+#include <unistd.h>
+#include <unordered_set>
 
 #include "lexer/lexer.hpp"
+#include "utils/file_utils.hpp"
+#include "utils/phase_timer.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/thread_pool.hpp"
+#include "utils/trace.hpp"
+
+static const std::string kCoolExtension{".cl"};
+static constexpr char kResponseFilePrefix{'@'};
+static constexpr char kResponseFileComment{'#'};
 
 struct CoolCCAppSettings {
-  std::string filename;
+  std::vector<std::string> inputs;
   std::string lexer_definition_file_name;
   bool lexer{false};
+  bool lexer_jit{false};
+  bool lexer_token_file{false};
+  bool lexer_pipeline{false};
+  std::size_t jobs{1};
+  std::string token_cache;
+  std::uint64_t token_cache_megabytes{TokenCache::kDefaultMaxBytes >> 20};
+  std::size_t max_errors{100};
+  DiagnosticFormat diagnostics_format{DiagnosticFormat::TEXT};
+  bool stats{false};
+  bool stats_json{false};
+};
+
+// Outcome of lexing one file
+struct FileResult {
+  LexerRunSummary summary;
+  double millis{0};
+  // Why the file could not be lexed; empty on success
+  std::string failure;
 };
 
+// Allocations through operator new, for --stats. Relaxed atomics are cheap
+// enough to count in every build.
+static std::atomic<std::uint64_t> num_allocations{0};
+static std::atomic<std::uint64_t> num_allocated_bytes{0};
+
+// The array and nothrow forms call these. The deletes are not inlined: GCC
+// would see free() on a pointer from operator new and warn about the
+// mismatch.
+void* operator new(const std::size_t size) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  num_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void* const ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc{};
+}
+
+void* operator new(const std::size_t size, const std::align_val_t alignment) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  num_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  // aligned_alloc takes a multiple of the alignment
+  const std::size_t align{static_cast<std::size_t>(alignment)};
+  const std::size_t aligned_size{(std::max<std::size_t>(size, 1) + align - 1) & ~(align - 1)};
+  if (void* const ptr = std::aligned_alloc(align, aligned_size)) {
+    return ptr;
+  }
+  throw std::bad_alloc{};
+}
+
+__attribute__((noinline)) void operator delete(void* const ptr) noexcept {
+  std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void* const ptr, const std::size_t) noexcept {
+  std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void* const ptr, const std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void* const ptr, const std::size_t,
+                                               const std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+struct AllocationCounts {
+  std::uint64_t allocations{0};
+  std::uint64_t bytes{0};
+};
+
+static AllocationCounts GetAllocationCounts() {
+  return {num_allocations.load(std::memory_order_relaxed),
+          num_allocated_bytes.load(std::memory_order_relaxed)};
+}
+
+static AllocationCounts operator-(const AllocationCounts& a, const AllocationCounts& b) {
+  return {a.allocations - b.allocations, a.bytes - b.bytes};
+}
+
+// What --stats reports
+struct RunStats {
+  // Loading the spec includes building its automatons
+  PhaseTime spec_load;
+  PhaseTime automatons;
+  // Summed over the files - with several jobs, more than the elapsed time
+  PhaseTime read;
+  PhaseTime lex;
+  PhaseTime write;
+  // Bytes of the files not loaded from the token cache, and their lex time
+  std::uint64_t lexed_bytes{0};
+  std::uint64_t lexed_wall_ns{0};
+  // Elapsed time of lexing all the files
+  std::uint64_t files_wall_ns{0};
+  AllocationCounts spec_allocations;
+  AllocationCounts files_allocations;
+  std::size_t num_files{0};
+  LexerRunSummary total;
+  std::size_t num_rules{0};
+  std::size_t num_modes{0};
+  std::size_t num_states{0};
+  ProcessUsage usage;
+};
+
+static double ToMillis(const std::uint64_t ns) {
+  return static_cast<double>(ns) / 1e6;
+}
+
+// Megabytes per second of num_bytes in ns
+static double GetThroughput(const std::uint64_t num_bytes, const std::uint64_t ns) {
+  return ns == 0 ? 0.0 : static_cast<double>(num_bytes) * 1e3 / static_cast<double>(ns);
+}
+
+static void PrintStatsText(const RunStats& stats, const TokenKindTable& kinds) {
+  const std::pair<const char*, const PhaseTime*> phases[]{
+    {"spec load", &stats.spec_load}, {"  automatons", &stats.automatons},
+    {"read", &stats.read}, {"lex", &stats.lex}, {"write", &stats.write}};
+  fmt::print("{:<16}{:>12}{:>12}\n", "phase", "wall ms", "cpu ms");
+  for (const auto& phase : phases) {
+    fmt::print("{:<16}{:>12.3f}{:>12.3f}\n", phase.first, ToMillis(phase.second->wall_ns),
+               ToMillis(phase.second->cpu_ns));
+  }
+  fmt::print("{} files, {} bytes, {} tokens, {} errors in {:.3f} ms\n", stats.num_files,
+             stats.total.num_bytes, stats.total.num_tokens, stats.total.num_errors,
+             ToMillis(stats.files_wall_ns));
+  fmt::print("throughput {:.2f} MB/s, lexing {:.2f} MB/s\n",
+             GetThroughput(stats.total.num_bytes, stats.files_wall_ns),
+             GetThroughput(stats.lexed_bytes, stats.lexed_wall_ns));
+  fmt::print("automatons: {} rules, {} modes, {} states\n", stats.num_rules, stats.num_modes,
+             stats.num_states);
+  fmt::print("allocations: {} ({} bytes) loading the spec, {} ({} bytes) lexing\n",
+             stats.spec_allocations.allocations, stats.spec_allocations.bytes,
+             stats.files_allocations.allocations, stats.files_allocations.bytes);
+  fmt::print("process: {:.3f} ms user, {:.3f} ms system, peak RSS {} KB\n",
+             ToMillis(stats.usage.user_ns), ToMillis(stats.usage.system_ns),
+             stats.usage.peak_rss_bytes >> 10);
+  fmt::print("tokens per kind:\n");
+  for (std::size_t kind = 0; kind < stats.total.kind_counts.size(); ++kind) {
+    if (stats.total.kind_counts[kind] == 0) { continue; }
+    fmt::print("  {:<24}{:>12}\n", kinds.Get(static_cast<TokenKind>(kind)).name,
+               stats.total.kind_counts[kind]);
+  }
+}
+
+// One JSON object; times in nanoseconds
+static void PrintStatsJson(const RunStats& stats, const TokenKindTable& kinds) {
+  const auto phase{[](const PhaseTime& time) {
+    return fmt::format("{{\"wall_ns\":{},\"cpu_ns\":{}}}", time.wall_ns, time.cpu_ns);
+  }};
+  std::string kind_counts;
+  for (std::size_t kind = 0; kind < stats.total.kind_counts.size(); ++kind) {
+    kind_counts += fmt::format("{}\"{}\":{}", kind == 0 ? "" : ",",
+                               kinds.Get(static_cast<TokenKind>(kind)).name,
+                               stats.total.kind_counts[kind]);
+  }
+  fmt::print("{{\"phases\":{{\"spec_load\":{},\"automatons\":{},\"read\":{},\"lex\":{},"
+             "\"write\":{}}},\"files_wall_ns\":{},\"files\":{},\"bytes\":{},\"tokens\":{},"
+             "\"errors\":{},\"bytes_per_second\":{:.0f},\"lex_bytes_per_second\":{:.0f},"
+             "\"automatons\":{{\"rules\":{},\"modes\":{},\"states\":{}}},"
+             "\"allocations\":{{\"spec_load\":{},\"spec_load_bytes\":{},\"lexing\":{},"
+             "\"lexing_bytes\":{}}},\"user_ns\":{},\"system_ns\":{},\"peak_rss_bytes\":{},"
+             "\"tokens_per_kind\":{{{}}}}}\n",
+             phase(stats.spec_load), phase(stats.automatons), phase(stats.read),
+             phase(stats.lex), phase(stats.write), stats.files_wall_ns, stats.num_files,
+             stats.total.num_bytes, stats.total.num_tokens, stats.total.num_errors,
+             GetThroughput(stats.total.num_bytes, stats.files_wall_ns) * 1e6,
+             GetThroughput(stats.lexed_bytes, stats.lexed_wall_ns) * 1e6,
+             stats.num_rules, stats.num_modes, stats.num_states,
+             stats.spec_allocations.allocations, stats.spec_allocations.bytes,
+             stats.files_allocations.allocations, stats.files_allocations.bytes,
+             stats.usage.user_ns, stats.usage.system_ns, stats.usage.peak_rss_bytes, kind_counts);
+}
+
+// Expand an input to files in a deterministic order. A directory stands for
+// the COOL files under it in name order, @file for the inputs listed in
+// file, one per line.
+static void ExpandInput(const std::string& input, std::vector<std::string>* const files) {
+  if (!input.empty() && input.front() == kResponseFilePrefix) {
+    for (const std::string& line : ReadFileLines(input.substr(1))) {
+      const std::string entry{Trim(line)};
+      if (!entry.empty() && entry.front() != kResponseFileComment) {
+        ExpandInput(entry, files);
+      }
+    }
+    return;
+  }
+
+  std::error_code error;
+  if (std::filesystem::is_directory(input, error)) {
+    std::vector<std::string> found;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator{input, error}) {
+      if (entry.is_regular_file() && entry.path().extension() == kCoolExtension) {
+        found.push_back(entry.path().string());
+      }
+    }
+    std::sort(found.begin(), found.end());
+    files->insert(files->end(), found.begin(), found.end());
+    return;
+  }
+
+  files->push_back(input);
+}
+
+// One line per file in input order, then the totals
+static void PrintSummary(const std::vector<std::string>& files,
+                         const std::vector<FileResult>& results,
+                         const std::size_t num_threads, const double millis) {
+  LexerRunSummary total;
+  std::size_t num_failed{0};
+  for (std::size_t i = 0; i < files.size(); ++i) {
+    const FileResult& result{results[i]};
+    if (!result.failure.empty()) {
+      fmt::print("{}: failed - {}\n", files[i], result.failure);
+      ++num_failed;
+      continue;
+    }
+    fmt::print("{}: {} tokens, {} errors, {} bytes, {:.1f} ms{}\n", files[i],
+               result.summary.num_tokens, result.summary.num_errors,
+               result.summary.num_bytes, result.millis,
+               result.summary.cached ? " (cached)" : "");
+    total.num_tokens += result.summary.num_tokens;
+    total.num_errors += result.summary.num_errors;
+    total.num_bytes += result.summary.num_bytes;
+  }
+  fmt::print("{} files ({} failed): {} tokens, {} errors, {} bytes, {:.1f} ms on {} threads\n",
+             files.size(), num_failed, total.num_tokens, total.num_errors, total.num_bytes,
+             millis, num_threads);
+}
+
+// The diagnostics of the files in input order to standard error, up to
+// max_errors in all
+static void PrintDiagnostics(const std::vector<FileResult>& results,
+                             const CoolCCAppSettings& settings) {
+  BufferedWriter out{STDERR_FILENO};
+  std::size_t num_left{settings.max_errors};
+  std::size_t num_omitted{0};
+  for (const FileResult& result : results) {
+    const auto& diagnostics{result.summary.diagnostics};
+    if (!diagnostics) { continue; }
+    const std::size_t num_rendered{diagnostics->Render(settings.diagnostics_format, num_left, &out)};
+    num_left -= num_rendered;
+    num_omitted += diagnostics->Size() - num_rendered;
+  }
+  out.Flush();
+  if (num_omitted > 0 && settings.diagnostics_format == DiagnosticFormat::TEXT) {
+    spdlog::warn("{} diagnostics beyond --max-errors not shown", num_omitted);
+  }
+}
+
 int Run(const CoolCCAppSettings& settings) {
-  spdlog::info("Cool source file {}", settings.filename);
   spdlog::info("Lexer definition filename ? {}", settings.lexer_definition_file_name);
   spdlog::info("Lexer on ? {}", settings.lexer);
 
-  Lexer lexer{settings.lexer_definition_file_name};
-  if (settings.lexer) {
-    lexer.RunLexerOn(settings.filename);
+  std::vector<std::string> inputs;
+  for (const std::string& input : settings.inputs) {
+    ExpandInput(input, &inputs);
+  }
+  // A file listed twice is lexed once - two jobs would write one output
+  std::vector<std::string> files;
+  std::unordered_set<std::string> seen;
+  for (const std::string& input : inputs) {
+    if (seen.insert(input).second) {
+      files.push_back(input);
+    }
+  }
+  spdlog::info("Cool source files {}", files.size());
+
+  if (!settings.lexer) {
+    return 0;
   }
 
+  // Workers share the spec; each keeps a Lexer for the files it takes
+  RunStats stats;
+  const AllocationCounts spec_start{GetAllocationCounts()};
+  std::shared_ptr<const LexerSpec> spec;
+  {
+    const ScopedPhaseTimer timer{&stats.spec_load};
+    spec = LexerSpec::Load(settings.lexer_definition_file_name);
+  }
+  stats.spec_allocations = GetAllocationCounts() - spec_start;
+  std::shared_ptr<TokenCache> token_cache;
+  if (!settings.token_cache.empty()) {
+    token_cache = std::make_shared<TokenCache>(settings.token_cache,
+                                               settings.token_cache_megabytes << 20);
+  }
+  WorkStealingPool pool{settings.jobs};
+  std::vector<std::unique_ptr<Lexer>> lexers(pool.GetNumThreads());
+  std::vector<FileResult> results(files.size());
 
+  const AllocationCounts files_start{GetAllocationCounts()};
+  const auto start{std::chrono::steady_clock::now()};
+  pool.Run(files.size(), [&](const std::size_t worker, const std::size_t job) {
+    std::unique_ptr<Lexer>& lexer{lexers[worker]};
+    if (!lexer) {
+      lexer.reset(new Lexer{spec});
+      lexer->EnableJit(settings.lexer_jit);
+      lexer->EnableTokenFile(settings.lexer_token_file);
+      lexer->EnablePipeline(settings.lexer_pipeline);
+      lexer->SetTokenCache(token_cache);
+    }
+
+    const auto file_start{std::chrono::steady_clock::now()};
+    try {
+      results[job].summary = lexer->RunLexerOn(files[job]);
+    } catch (const std::exception& e) {
+      results[job].failure = e.what();
+      lexer->Reset();
+    }
+    results[job].millis = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - file_start).count();
+  });
+  const auto end{std::chrono::steady_clock::now()};
+  stats.files_allocations = GetAllocationCounts() - files_start;
+  const double millis{std::chrono::duration<double, std::milli>(end - start).count()};
+
+  PrintDiagnostics(results, settings);
+
+  if (files.size() > 1) {
+    PrintSummary(files, results, pool.GetNumThreads(), millis);
+  } else if (!results.empty() && !results.front().failure.empty()) {
+    spdlog::error("{}: failed - {}", files.front(), results.front().failure);
+  }
+  if (token_cache) {
+    const TokenCacheStats stats{token_cache->GetStats()};
+    fmt::print("token cache {}: {} hits, {} misses, {} stored, {} evicted\n",
+               token_cache->GetDirectory(), stats.hits, stats.misses, stats.stores,
+               stats.evictions);
+  }
+
+  if (settings.stats) {
+    stats.automatons = spec->GetAutomatonTime();
+    stats.files_wall_ns = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    stats.num_files = files.size();
+    stats.total.kind_counts.assign(spec->GetTokenKinds().Size(), 0);
+    for (const FileResult& result : results) {
+      if (!result.failure.empty()) { continue; }
+      const LexerRunSummary& summary{result.summary};
+      stats.read += summary.read_time;
+      stats.lex += summary.lex_time;
+      stats.write += summary.write_time;
+      if (!summary.cached) {
+        stats.lexed_bytes += summary.num_bytes;
+        stats.lexed_wall_ns += summary.lex_time.wall_ns;
+      }
+      stats.total.num_bytes += summary.num_bytes;
+      stats.total.num_tokens += summary.num_tokens;
+      stats.total.num_errors += summary.num_errors;
+      for (std::size_t kind = 0; kind < summary.kind_counts.size(); ++kind) {
+        stats.total.kind_counts[kind] += summary.kind_counts[kind];
+      }
+    }
+    stats.num_rules = spec->GetNumRules();
+    stats.num_modes = spec->GetNumModes();
+    stats.num_states = spec->GetNumStates();
+    stats.usage = GetProcessUsage();
+    if (settings.stats_json) {
+      PrintStatsJson(stats, spec->GetTokenKinds());
+    } else {
+      PrintStatsText(stats, spec->GetTokenKinds());
+    }
+  }
 
-  return 0;
+  const bool failed{std::any_of(results.begin(), results.end(),
+                                [](const FileResult& result) { return !result.failure.empty(); })};
+  return failed ? 1 : 0;
 }
 
 int main(int argc, char** argv) {
 #if defined(CCDEBUG)
-  spdlog::set_level(
-        static_cast<spdlog::level::level_enum>(spdlog::level::level_enum::debug));
+  Trace::SetLevel(spdlog::level::debug);
 #endif
 
   CoolCCAppSettings settings;
 
   CLI::App app{"cool-cc - A COOL compiler impl."};
-  app.add_option("-f", settings.filename, "COOL source file");
+  app.add_option("-f", settings.inputs,
+                 "COOL source files, directories of them or @files listing them");
+  app.add_option("-j,--jobs", settings.jobs,
+                 "Lex this many files at once; 0 for one per hardware thread");
   app.add_option("--lexer-definition-filename",
                  settings.lexer_definition_file_name,
                  "File defining the tokens and the corresponding regex");
   app.add_flag("--lexer", settings.lexer, "Run the lexer");
+  app.add_flag("--lexer-jit", settings.lexer_jit,
+               "Compile the token automatons to native code");
+  app.add_flag("--lexer-cctok", settings.lexer_token_file,
+               "Also write the tokens to a binary .cctok file");
+  app.add_flag("--lexer-pipeline", settings.lexer_pipeline,
+               "Lex on a separate thread while the output is written");
+  app.add_option("--token-cache", settings.token_cache,
+                 "Keep the tokens of lexed files in this directory and reuse them "
+                 "while a file and the lexer definition are unchanged");
+  app.add_option("--token-cache-size", settings.token_cache_megabytes,
+                 "Evict the least recently used cached tokens beyond this many MB");
+  app.add_option("--max-errors", settings.max_errors,
+                 "Show at most this many diagnostics over all the files");
+  app.add_option("--diagnostics-format", settings.diagnostics_format,
+                 "Show diagnostics as text or as one JSON object per line")
+    ->transform(CLI::CheckedTransformer(std::map<std::string, DiagnosticFormat>{
+      {"text", DiagnosticFormat::TEXT}, {"json", DiagnosticFormat::JSON}}));
+  app.add_flag("--stats", settings.stats,
+               "Report the time of each phase, token counts, throughput, automaton sizes, "
+               "allocations and peak memory");
+  app.add_flag("--stats-json", settings.stats_json, "Report --stats as one JSON object")
+    ->needs("--stats");
   CLI11_PARSE(app, argc, argv);
 
   return Run(settings);
@@ -0,0 +1,130 @@
+#include "error_handler/diagnostics.hpp"
+#include <algorithm>
+#include <cassert>
+#include <fmt/format.h>
+
+static const char* GetSeverityName(const Severity severity) {
+  switch (severity) {
+  case Severity::NOTE: return "note";
+  case Severity::WARNING: return "warning";
+  case Severity::ERROR: return "error";
+  }
+  return "";
+}
+
+// Escape text for a JSON string
+static void WriteJsonString(const std::string_view text, BufferedWriter* const out) {
+  out->Write('"');
+  for (const char c : text) {
+    switch (c) {
+    case '"': out->Write("\\\""); break;
+    case '\\': out->Write("\\\\"); break;
+    case '\n': out->Write("\\n"); break;
+    case '\t': out->Write("\\t"); break;
+    case '\r': out->Write("\\r"); break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        out->Write(fmt::format("\\u{:04x}", static_cast<unsigned char>(c)));
+      } else {
+        out->Write(c);
+      }
+    }
+  }
+  out->Write('"');
+}
+
+DiagnosticBuffer::DiagnosticBuffer(const std::string& file_name,
+                                   const std::shared_ptr<const SourceBuffer>& source) :
+  file_name_{file_name},
+  source_{source} {
+}
+
+void DiagnosticBuffer::KeepLineText(const std::string_view line) {
+  assert (!diagnostics_.empty());
+  diagnostics_.back().line_text = static_cast<std::uint32_t>(line_texts_.size());
+  line_texts_.emplace_back(line);
+}
+
+void DiagnosticBuffer::Finish() {
+  std::stable_sort(diagnostics_.begin(), diagnostics_.end(),
+                   [](const Diagnostic& a, const Diagnostic& b) { return a.offset < b.offset; });
+  const auto last{std::unique(diagnostics_.begin(), diagnostics_.end(),
+                              [](const Diagnostic& a, const Diagnostic& b) {
+                                return a.kind == b.kind && a.offset == b.offset;
+                              })};
+  diagnostics_.erase(last, diagnostics_.end());
+  if (diagnostics_.empty()) {
+    // Nothing to show the source for
+    source_.reset();
+  }
+  num_errors_ = static_cast<std::size_t>(
+    std::count_if(diagnostics_.begin(), diagnostics_.end(), [](const Diagnostic& diagnostic) {
+      return diagnostic.kind->severity == Severity::ERROR;
+    }));
+}
+
+std::string DiagnosticBuffer::FormatMessage(const Diagnostic& diagnostic) {
+  return fmt::format(fmt::runtime(diagnostic.kind->format),
+                     diagnostic.args[0], diagnostic.args[1]);
+}
+
+std::size_t DiagnosticBuffer::Render(const DiagnosticFormat format,
+                                     const std::size_t max_diagnostics,
+                                     BufferedWriter* const out) const {
+  const std::size_t num_rendered{std::min(max_diagnostics, diagnostics_.size())};
+  for (std::size_t i = 0; i < num_rendered; ++i) {
+    if (format == DiagnosticFormat::JSON) {
+      RenderJson(diagnostics_[i], out);
+    } else {
+      RenderText(diagnostics_[i], out);
+    }
+  }
+  return num_rendered;
+}
+
+std::string_view DiagnosticBuffer::GetLineText(const Diagnostic& diagnostic) const {
+  if (diagnostic.line_text != kNoLineText) {
+    return line_texts_[diagnostic.line_text];
+  }
+  if (!source_ || diagnostic.offset > source_->size() || diagnostic.col_no > diagnostic.offset) {
+    return {};
+  }
+  const std::string_view line{source_->View().substr(diagnostic.offset - diagnostic.col_no)};
+  return line.substr(0, line.find('\n'));
+}
+
+void DiagnosticBuffer::RenderText(const Diagnostic& diagnostic, BufferedWriter* const out) const {
+  // file:line:column: severity: message [code], then the line with a caret
+  // under the column and a tilde under the rest of the input on the line
+  out->Write(fmt::format("{}:{}:{}: {}: {} [{}]\n", file_name_, diagnostic.line_no + 1,
+                         diagnostic.col_no + 1, GetSeverityName(diagnostic.kind->severity),
+                         FormatMessage(diagnostic), diagnostic.kind->code));
+  const std::string_view line{GetLineText(diagnostic)};
+  if (line.empty() || diagnostic.col_no > line.length()) { return; }
+
+  out->Write("  ");
+  out->Write(line);
+  out->Write("\n  ");
+  for (std::size_t col = 0; col < diagnostic.col_no; ++col) {
+    // Tabs are kept so that the caret lines up
+    out->Write(line[col] == '\t' ? '\t' : ' ');
+  }
+  out->Write('^');
+  const std::size_t underline{std::min<std::size_t>(diagnostic.length, line.length() - diagnostic.col_no)};
+  for (std::size_t col = 1; col < underline; ++col) {
+    out->Write('~');
+  }
+  out->Write('\n');
+}
+
+void DiagnosticBuffer::RenderJson(const Diagnostic& diagnostic, BufferedWriter* const out) const {
+  out->Write("{\"file\":");
+  WriteJsonString(file_name_, out);
+  out->Write(fmt::format(",\"line\":{},\"column\":{},\"offset\":{},\"length\":{},"
+                         "\"severity\":\"{}\",\"code\":\"{}\",\"message\":",
+                         diagnostic.line_no + 1, diagnostic.col_no + 1, diagnostic.offset,
+                         diagnostic.length, GetSeverityName(diagnostic.kind->severity),
+                         diagnostic.kind->code));
+  WriteJsonString(FormatMessage(diagnostic), out);
+  out->Write("}\n");
+}
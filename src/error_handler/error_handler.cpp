@@ -1,19 +1,30 @@
 #include "error_handler/error_handler.hpp"
+#include <cassert>
 #include <spdlog/spdlog.h>
 #include <fmt/format.h>
 #include <utils/file_utils.hpp>
 
+ErrorHandler::ErrorHandler(const std::string& prefix,
+			   const std::shared_ptr<const SourceBuffer>& source) :
+  prefix_{prefix},
+  file_name_{source->GetFileName()},
+  file_location_{new FileLocation{source}} {
+}
+
 ErrorHandler::ErrorHandler(const std::string& prefix,
 			   const std::string& file_name) :
   prefix_{prefix},
-  file_name_{file_name},
-  file_location_{file_name} {
+  file_name_{file_name} {
 }
 
 void ErrorHandler::ConsolePrint(const std::size_t buf_idx,
 			       	const std::string& msg) {
+  assert (file_location_);
+  ConsolePrint(file_location_->GetFileLocationInfo(buf_idx), msg);
+}
 
-  const auto file_location_info{file_location_.GetFileLocationInfo(buf_idx)};
+void ErrorHandler::ConsolePrint(const FileLocationInfo& file_location_info,
+				const std::string& msg) {
 
   const std::string err_msg_wo_line{
     fmt::format("{} {}:{} -", prefix_, file_name_, file_location_info.line_no + 1)};
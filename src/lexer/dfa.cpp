@@ -3,6 +3,7 @@
 #include <iostream>
 #include "lexer/dfa.hpp"
 #include "spdlog/spdlog.h"
+#include "utils/trace.hpp"
 #include "lexer/regex_tree_nodes.hpp"
 #include "lexer/lex_character_classes.hpp"
 #include <iterator>
@@ -12,7 +13,19 @@
 #include <unordered_map>
 #include <queue>
 
-DFA::DFA(const std::string& regex) :
+const char* DFAConstructionPhaseName(const DFAConstructionPhase phase) {
+  switch (phase) {
+    case DFA_PHASE_PARSE: return "parse";
+    case DFA_PHASE_POSITIONS: return "positions";
+    case DFA_PHASE_FIRSTPOS_LASTPOS: return "firstpos/lastpos";
+    case DFA_PHASE_FOLLOWPOS: return "followpos";
+    case DFA_PHASE_SUBSET_CONSTRUCTION: return "subset";
+    default: break;
+  }
+  return "invalid";
+}
+
+DFA::DFA(const std::string& regex, DFAPhaseListener* const listener) :
   regex_{regex},
   augmented_regex_{regex+"#"},
   nodepos_symbols_{},
@@ -20,41 +33,59 @@ DFA::DFA(const std::string& regex) :
   dfa_{},
   dfa_accepting_states_{} {
 
+  auto phase_start = [&](const DFAConstructionPhase phase) {
+    if (listener) { listener->OnPhaseStart(phase); }
+  };
+  auto phase_end = [&](const DFAConstructionPhase phase) {
+    if (listener) { listener->OnPhaseEnd(phase); }
+  };
+
   // Make regex tree
-  spdlog::debug("Making Regex Tree for {} ...", augmented_regex_);
+  CC_DEBUG("Making Regex Tree for {} ...", augmented_regex_);
+  phase_start(DFA_PHASE_PARSE);
   regex_tree_ = MakeRegexTree(augmented_regex_);
+  phase_end(DFA_PHASE_PARSE);
 
+  phase_start(DFA_PHASE_POSITIONS);
   // Annotate leaf nodes sequentially from left to right
-  spdlog::debug("Annotating leaf nodes ...");
+  CC_DEBUG("Annotating leaf nodes ...");
   MarkLeafNodesLeftToRight(regex_tree_);
 
   // Get lead node position and symbols
-  spdlog::debug("Constructing leaf-node positions and symbols ...");
+  CC_DEBUG("Constructing leaf-node positions and symbols ...");
   ConstructNodeposSymbols(regex_tree_);
+  phase_end(DFA_PHASE_POSITIONS);
 
+  phase_start(DFA_PHASE_FIRSTPOS_LASTPOS);
   // Ascertain which nodes are nullable
-  spdlog::debug("Computing nullable ...");
+  CC_DEBUG("Computing nullable ...");
   regex_tree_->ComputeIsNullable();
 
-  spdlog::debug("Computing first pos ...");
+  CC_DEBUG("Computing first pos ...");
   regex_tree_->ComputeFirstPos();
 
-  spdlog::debug("Computing last pos ...");
+  CC_DEBUG("Computing last pos ...");
   regex_tree_->ComputeLastPos();
+  phase_end(DFA_PHASE_FIRSTPOS_LASTPOS);
 
   //spdlog::info("Drawing regex tree...");
   //DrawRegexTree(regex_tree_);
   //spdlog::info("Inorder traversal ...");
   //InorderTraversal(regex_tree_);
 
-  spdlog::debug("Regex Tree -> NFA ...");
+  CC_DEBUG("Regex Tree -> NFA ...");
+  phase_start(DFA_PHASE_FOLLOWPOS);
   RegexTreeToNFA(regex_tree_);
+  phase_end(DFA_PHASE_FOLLOWPOS);
 
   //spdlog::debug("Printing NFA transitions ...");
   //PrintNFATransitions();
 
-  spdlog::debug("Subset construction ...");
+  CC_DEBUG("Subset construction ...");
+  phase_start(DFA_PHASE_SUBSET_CONSTRUCTION);
   SubsetConstruction();
+  BuildTransitionTable();
+  phase_end(DFA_PHASE_SUBSET_CONSTRUCTION);
 
   //spdlog::debug("Printing DFA transitions ...");
   //PrintDFATransitions();
@@ -74,17 +105,14 @@ void DFA::Reset() {
 
 int DFA::MoveOnSymbol(const char symbol) {
   // Is there a transition from the current dfa state on the symbol
-  if (dfa_.find(current_dfa_state_) == dfa_.end() ||
-      dfa_.at(current_dfa_state_).find(symbol) == dfa_.at(current_dfa_state_).end()){
-    current_dfa_state_ = -1;
-  } else {
-    current_dfa_state_ = dfa_.at(current_dfa_state_).at(symbol);
+  if (current_dfa_state_ >= 0) {
+    current_dfa_state_ = GetTransition(current_dfa_state_, symbol);
   }
   return current_dfa_state_;
 }
 
 bool DFA::InAcceptingState() const {
-  return dfa_accepting_states_.find(current_dfa_state_) != dfa_accepting_states_.end();
+  return IsAcceptingState(current_dfa_state_);
 }
 
 bool DFA::InErrorState() const {
@@ -94,7 +122,7 @@ bool DFA::InErrorState() const {
 bool DFA::Test(const std::string& test_str) {
   Reset();
   for (const auto x : test_str) {
-    spdlog::debug(fmt::format("move on symbol {}", x));
+    CC_TRACE("move on symbol {}", x);
     MoveOnSymbol(x);
   }
   const bool accept{InAcceptingState()};
@@ -134,7 +162,7 @@ void DFA::SubsetConstruction() {
   std::set<int> seed_nfa_states;
   std::transform(seed_nfa_states_unordered.begin(), seed_nfa_states_unordered.end(),
                  std::inserter(seed_nfa_states, seed_nfa_states.begin()), [](int x){return x;});
-  spdlog::debug(fmt::format("seed nfa states {}", set_to_string(seed_nfa_states)));
+  CC_DEBUG("seed nfa states {}", set_to_string(seed_nfa_states));
   std::unordered_set<std::string> state_visited;
   std::queue<std::set<int> > q;
   q.push(seed_nfa_states);
@@ -179,14 +207,10 @@ void DFA::SubsetConstruction() {
 
   // Print dfa transitions
   for (const auto& dfa_transition : dfa_transitions) {
-    std::string transition_symbols;
-    for (const auto c : dfa_transition.transition_symbols) {
-      transition_symbols += fmt::format(" {}", c);
-    }
-    spdlog::debug("{} on {} goes to {}",
-                 set_to_string(dfa_transition.from_nfa_states),
-                 transition_symbols,
-                 set_to_string(dfa_transition.to_nfa_states));
+    CC_DEBUG("{} on {} goes to {}",
+             set_to_string(dfa_transition.from_nfa_states),
+             fmt::join(dfa_transition.transition_symbols, " "),
+             set_to_string(dfa_transition.to_nfa_states));
   }
 
   // Post-Processing - Assign DFA state indices
@@ -195,7 +219,7 @@ void DFA::SubsetConstruction() {
   assert (regex_tree_->GetRightSubTree()->GetNodeType() == NodeType::NODE_TYPE_LEAF);
   const int nfa_accepting_state{
       dynamic_cast<const LeafNode*>(regex_tree_->GetRightSubTree().get())->GetNodePosition()};
-  spdlog::debug(fmt::format("nfa accepting state {}", nfa_accepting_state));
+  CC_DEBUG("nfa accepting state {}", nfa_accepting_state);
   std::unordered_map<std::string, int> nfa_states_to_dfa_state_map;
   int dfa_state_idx = 0;
 
@@ -244,6 +268,54 @@ void DFA::SubsetConstruction() {
     nfa_states_to_dfa_state_map.at(set_to_string(seed_nfa_states));
 }
 
+void DFA::BuildTransitionTable() {
+  // States are numbered densely from 0; a state may have no outgoing
+  // transitions, so look at both ends of every transition
+  int num_states{dfa_start_state_ + 1};
+  for (const auto& s_transitions : dfa_) {
+    num_states = std::max(num_states, s_transitions.first + 1);
+    for (const auto& symbol_sdash : s_transitions.second) {
+      num_states = std::max(num_states, symbol_sdash.second + 1);
+    }
+  }
+
+  accepting_.assign(num_states, false);
+  for (const auto s : dfa_accepting_states_) { accepting_.at(s) = true; }
+
+  // Which states can still reach an accepting state ? Propagate backwards
+  // from the accepting states over the reversed transitions
+  std::vector<std::vector<int>> predecessors(num_states);
+  for (const auto& s_transitions : dfa_) {
+    for (const auto& symbol_sdash : s_transitions.second) {
+      predecessors.at(symbol_sdash.second).push_back(s_transitions.first);
+    }
+  }
+  std::vector<bool> can_reach_accept{accepting_};
+  std::stack<int> work;
+  for (int s = 0; s < num_states; ++s) {
+    if (can_reach_accept.at(s)) { work.push(s); }
+  }
+  while (!work.empty()) {
+    const int s{work.top()};
+    work.pop();
+    for (const auto p : predecessors.at(s)) {
+      if (!can_reach_accept.at(p)) {
+        can_reach_accept.at(p) = true;
+        work.push(p);
+      }
+    }
+  }
+
+  transition_table_.assign(num_states * kNumSymbols, -1);
+  for (const auto& s_transitions : dfa_) {
+    for (const auto& symbol_sdash : s_transitions.second) {
+      if (!can_reach_accept.at(symbol_sdash.second)) { continue; }
+      transition_table_.at(s_transitions.first * kNumSymbols +
+                           static_cast<unsigned char>(symbol_sdash.first)) = symbol_sdash.second;
+    }
+  }
+}
+
 std::shared_ptr<Node> DFA::MakeRegexTree(const std::string& regex) {
 
   /* A star node always corresponds to the symbol before the star.
@@ -317,6 +389,11 @@ std::shared_ptr<Node> DFA::MakeRegexTree(const std::string& regex) {
     pos++;
 
     while (pos < int(regex.size()) && match) {
+      // Escaped characters never open or close
+      if (is_bslash(regex.at(pos))) {
+	pos += 2;
+	continue;
+      }
       if (is_open_char(regex.at(pos))) {
 	match++;
       }
@@ -563,13 +640,7 @@ void DFA::RegexTreeToNFA(const std::shared_ptr<Node> tree) {
   }
 
   for (const auto& pos_followpos : position_followpos) {
-    auto p = pos_followpos.first;
-    auto& fp = pos_followpos.second;
-    std::string fp_str = fmt::format("{} - follow ", p);
-    for (const auto fpp : fp) {
-      fp_str += fmt::format(" {}", fpp);
-    }
-    spdlog::debug(fp_str);
+    CC_DEBUG("{} - follow {}", pos_followpos.first, fmt::join(pos_followpos.second, " "));
   }
 
   // Update nfa_ based on position_followpos
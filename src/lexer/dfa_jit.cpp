@@ -0,0 +1,304 @@
+// Compile token automatons to native x86-64 code
+#include "lexer/dfa_jit.hpp"
+#include "spdlog/spdlog.h"
+#include "utils/trace.hpp"
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <fmt/format.h>
+
+namespace {
+
+// States with more outgoing symbol ranges than this dispatch through a jump
+// table instead of a chain of compares
+constexpr int kJumpTableThreshold{6};
+
+// Minimal x86-64 assembler - just the instructions the scanner needs.
+// Register usage of the generated function (System V ABI),
+//   rdi - current input pointer (first argument: begin)
+//   rsi - end of input (second argument)
+//   r8  - begin
+//   rax - longest match of the current automaton, -1 if none
+//   rcx - current symbol, rdx/r9 - scratch
+//   r10 - longest match over all automatons, r11 - its automaton index
+//   [rsp - 8] - furthest input pointer read, [rsp - 16] - scan_length (third
+//   argument); the function is a leaf, so both live in the red zone
+class Assembler {
+public:
+  int NewLabel() {
+    labels_.push_back(-1);
+    return static_cast<int>(labels_.size()) - 1;
+  }
+
+  void Bind(const int label) {
+    assert (labels_.at(label) == -1);
+    labels_.at(label) = static_cast<long>(code_.size());
+  }
+
+  void Emit(std::initializer_list<std::uint8_t> bytes) {
+    code_.insert(code_.end(), bytes.begin(), bytes.end());
+  }
+
+  void Emit32(const std::uint32_t x) {
+    for (int i = 0; i < 4; ++i) { code_.push_back((x >> (8 * i)) & 0xff); }
+  }
+
+  // Jump (or conditional jump with opcode 0F cc) to label
+  void Jump(const int label) { Emit({0xE9}); Rel32(label); }
+  void JumpIfEqual(const int label) { Emit({0x0F, 0x84}); Rel32(label); }
+  void JumpIfBelowOrEqual(const int label) { Emit({0x0F, 0x86}); Rel32(label); }
+  void JumpIfAboveOrEqual(const int label) { Emit({0x0F, 0x83}); Rel32(label); }
+  void JumpIfLessOrEqual(const int label) { Emit({0x0F, 0x8E}); Rel32(label); }
+
+  // lea rdx, [rip + table]; table is bound by the caller
+  void LeaRdxTable(const int table_label) { Emit({0x48, 0x8D, 0x15}); Rel32(table_label); }
+
+  // Jump table entry - offset of label relative to the table start
+  void TableEntry(const int label, const int table_label) {
+    table_fixups_.push_back({code_.size(), label, table_label});
+    Emit32(0);
+  }
+
+  void Align(const std::size_t alignment) {
+    while (code_.size() % alignment) { Emit({0x90}); }
+  }
+
+  std::vector<std::uint8_t> Finish() {
+    for (const auto& f : rel32_fixups_) {
+      const long target{labels_.at(f.label)};
+      assert (target >= 0);
+      Patch32(f.pos, static_cast<std::uint32_t>(target - static_cast<long>(f.pos + 4)));
+    }
+    for (const auto& f : table_fixups_) {
+      const long target{labels_.at(f.label)};
+      const long table{labels_.at(f.table_label)};
+      assert (target >= 0 && table >= 0);
+      Patch32(f.pos, static_cast<std::uint32_t>(target - table));
+    }
+    return code_;
+  }
+
+private:
+  struct Rel32Fixup {
+    std::size_t pos;
+    int label;
+  };
+  struct TableFixup {
+    std::size_t pos;
+    int label;
+    int table_label;
+  };
+
+  std::vector<std::uint8_t> code_;
+  std::vector<long> labels_;
+  std::vector<Rel32Fixup> rel32_fixups_;
+  std::vector<TableFixup> table_fixups_;
+
+  void Rel32(const int label) {
+    rel32_fixups_.push_back({code_.size(), label});
+    Emit32(0);
+  }
+
+  void Patch32(const std::size_t pos, const std::uint32_t x) {
+    for (int i = 0; i < 4; ++i) { code_.at(pos + i) = (x >> (8 * i)) & 0xff; }
+  }
+};
+
+struct SymbolRange {
+  int lo;
+  int hi;
+  int state;
+};
+
+// Group the outgoing transitions of a state into maximal symbol ranges
+std::vector<SymbolRange> GetSymbolRanges(const DFA& dfa, const int state) {
+  std::vector<SymbolRange> ranges;
+  for (int c = 0; c < 256; ++c) {
+    const int to{dfa.GetTransition(state, static_cast<char>(c))};
+    if (to < 0) { continue; }
+    if (!ranges.empty() && ranges.back().hi == c - 1 && ranges.back().state == to) {
+      ranges.back().hi = c;
+    } else {
+      ranges.push_back({c, c, to});
+    }
+  }
+  return ranges;
+}
+
+void EmitAutomaton(Assembler& a, const DFA& dfa, const int automaton_idx) {
+  const int num_states{dfa.GetNumStates()};
+  std::vector<int> entry_labels;
+  std::vector<int> scan_labels;
+  for (int s = 0; s < num_states; ++s) {
+    entry_labels.push_back(a.NewLabel());
+    scan_labels.push_back(a.NewLabel());
+  }
+  const int done{a.NewLabel()};
+  const int next{a.NewLabel()};
+
+  a.Emit({0x4C, 0x89, 0xC7});                               // mov rdi, r8
+  a.Emit({0x48, 0xC7, 0xC0, 0xFF, 0xFF, 0xFF, 0xFF});       // mov rax, -1
+  // Nothing has been consumed in the start state; skip its accept bookkeeping
+  a.Jump(scan_labels.at(dfa.GetStartState()));
+
+  for (int s = 0; s < num_states; ++s) {
+    a.Bind(entry_labels.at(s));
+    if (dfa.IsAcceptingState(s)) {
+      a.Emit({0x48, 0x89, 0xF8});                           // mov rax, rdi
+      a.Emit({0x4C, 0x29, 0xC0});                           // sub rax, r8
+    }
+    a.Bind(scan_labels.at(s));
+
+    const auto ranges{GetSymbolRanges(dfa, s)};
+    if (ranges.empty()) {
+      a.Jump(done);
+      continue;
+    }
+
+    a.Emit({0x48, 0x39, 0xF7});                             // cmp rdi, rsi
+    a.JumpIfAboveOrEqual(done);
+    a.Emit({0x0F, 0xB6, 0x0F});                             // movzx ecx, byte [rdi]
+    a.Emit({0x48, 0xFF, 0xC7});                             // inc rdi
+
+    if (static_cast<int>(ranges.size()) > kJumpTableThreshold) {
+      const int table{a.NewLabel()};
+      a.LeaRdxTable(table);
+      a.Emit({0x4C, 0x63, 0x0C, 0x8A});                     // movsxd r9, dword [rdx + rcx * 4]
+      a.Emit({0x49, 0x01, 0xD1});                           // add r9, rdx
+      a.Emit({0x41, 0xFF, 0xE1});                           // jmp r9
+      a.Align(4);
+      a.Bind(table);
+      std::size_t r = 0;
+      for (int c = 0; c < 256; ++c) {
+        while (r < ranges.size() && ranges.at(r).hi < c) { r++; }
+        const bool in_range{r < ranges.size() && ranges.at(r).lo <= c};
+        a.TableEntry(in_range ? entry_labels.at(ranges.at(r).state) : done, table);
+      }
+      continue;
+    }
+
+    for (const auto& range : ranges) {
+      if (range.lo == range.hi) {
+        a.Emit({0x81, 0xF9}); a.Emit32(range.lo);           // cmp ecx, lo
+        a.JumpIfEqual(entry_labels.at(range.state));
+      } else {
+        a.Emit({0x89, 0xCA});                               // mov edx, ecx
+        a.Emit({0x81, 0xEA}); a.Emit32(range.lo);           // sub edx, lo
+        a.Emit({0x81, 0xFA}); a.Emit32(range.hi - range.lo);// cmp edx, hi - lo
+        a.JumpIfBelowOrEqual(entry_labels.at(range.state));
+      }
+    }
+    a.Jump(done);
+  }
+
+  // Keep the match if it is strictly longer than the best so far
+  a.Bind(done);
+  const int not_further{a.NewLabel()};
+  a.Emit({0x48, 0x3B, 0x7C, 0x24, 0xF8});                   // cmp rdi, [rsp - 8]
+  a.JumpIfBelowOrEqual(not_further);
+  a.Emit({0x48, 0x89, 0x7C, 0x24, 0xF8});                   // mov [rsp - 8], rdi
+  a.Bind(not_further);
+  a.Emit({0x4C, 0x39, 0xD0});                               // cmp rax, r10
+  a.JumpIfLessOrEqual(next);
+  a.Emit({0x49, 0x89, 0xC2});                               // mov r10, rax
+  a.Emit({0x41, 0xBB}); a.Emit32(automaton_idx);            // mov r11d, automaton_idx
+  a.Bind(next);
+}
+
+std::vector<std::uint8_t> GenerateCode(const std::vector<const DFA*>& automatons) {
+  Assembler a;
+  const int no_match{a.NewLabel()};
+
+  a.Emit({0x49, 0x89, 0xF8});                               // mov r8, rdi
+  a.Emit({0x48, 0x89, 0x7C, 0x24, 0xF8});                   // mov [rsp - 8], rdi
+  a.Emit({0x48, 0x89, 0x54, 0x24, 0xF0});                   // mov [rsp - 16], rdx
+  a.Emit({0x45, 0x31, 0xD2});                               // xor r10d, r10d
+  a.Emit({0x49, 0xC7, 0xC3, 0xFF, 0xFF, 0xFF, 0xFF});       // mov r11, -1
+
+  for (std::size_t i = 0; i < automatons.size(); ++i) {
+    EmitAutomaton(a, *automatons.at(i), static_cast<int>(i));
+  }
+
+  a.Emit({0x48, 0x8B, 0x54, 0x24, 0xF0});                   // mov rdx, [rsp - 16]
+  a.Emit({0x48, 0x8B, 0x4C, 0x24, 0xF8});                   // mov rcx, [rsp - 8]
+  a.Emit({0x4C, 0x29, 0xC1});                               // sub rcx, r8
+  a.Emit({0x48, 0x89, 0x0A});                               // mov [rdx], rcx
+  a.Emit({0x4D, 0x85, 0xD2});                               // test r10, r10
+  a.JumpIfEqual(no_match);
+  a.Emit({0x4C, 0x89, 0xD8});                               // mov rax, r11
+  a.Emit({0x48, 0xC1, 0xE0, 0x20});                         // shl rax, 32
+  a.Emit({0x4C, 0x09, 0xD0});                               // or rax, r10
+  a.Emit({0xC3});                                           // ret
+  a.Bind(no_match);
+  a.Emit({0x48, 0xC7, 0xC0, 0xFF, 0xFF, 0xFF, 0xFF});       // mov rax, -1
+  a.Emit({0xC3});                                           // ret
+
+  return a.Finish();
+}
+
+} // namespace
+
+bool DFAJit::IsSupported() {
+#if defined(__x86_64__)
+  return true;
+#else
+  return false;
+#endif
+}
+
+DFAJit::DFAJit(const std::vector<const DFA*>& automatons) {
+  if (!IsSupported()) {
+    spdlog::warn("DFA JIT is not supported on this platform");
+    return;
+  }
+
+  const std::vector<std::uint8_t> code{GenerateCode(automatons)};
+
+  void* const region{mmap(nullptr, code.size(), PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)};
+  if (region == MAP_FAILED) {
+    spdlog::warn("DFA JIT - cannot map code region");
+    return;
+  }
+  std::memcpy(region, code.data(), code.size());
+  if (mprotect(region, code.size(), PROT_READ | PROT_EXEC) != 0) {
+    spdlog::warn("DFA JIT - cannot make code region executable");
+    munmap(region, code.size());
+    return;
+  }
+
+  code_ = region;
+  code_size_ = code.size();
+  match_fn_ = reinterpret_cast<MatchFn>(code_);
+  CC_DEBUG("DFA JIT - {} automatons, {} bytes of code", automatons.size(), code_size_);
+}
+
+DFAJit::~DFAJit() {
+  if (code_) {
+    munmap(code_, code_size_);
+  }
+}
+
+bool DFAJit::Match(const char* const begin, const char* const end,
+                   int* const automaton_idx, std::size_t* const length,
+                   std::size_t* const scan_length) const {
+  assert (match_fn_);
+  assert (automaton_idx);
+  assert (length);
+
+  // The native code returns the length in the low 32 bits of the match
+  if (static_cast<std::size_t>(end - begin) > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::length_error(fmt::format("Cannot match in {} bytes of input", end - begin));
+  }
+
+  long scanned{0};
+  const long match{match_fn_(begin, end, &scanned)};
+  if (scan_length) { *scan_length = static_cast<std::size_t>(scanned); }
+  if (match < 0) { return false; }
+  *automaton_idx = static_cast<int>(match >> 32);
+  *length = static_cast<std::size_t>(match & 0xffffffff);
+  return true;
+}
@@ -0,0 +1,178 @@
+// Define the incremental lexer
+#include "lexer/incremental_lexer.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <fmt/format.h>
+#include "utils/source_buffer.hpp"
+
+// Move the positions in [first, last) by delta bytes
+static void ShiftPositions(std::vector<std::size_t>* const positions, const std::size_t first,
+                           const std::size_t last, const std::int64_t delta) {
+  for (std::size_t i = first; i < last; ++i) {
+    (*positions)[i] = static_cast<std::size_t>((*positions)[i] + delta);
+  }
+}
+
+IncrementalLexer::IncrementalLexer(const std::shared_ptr<const LexerSpec>& spec) :
+  lexer_{spec},
+  source_{SourceBuffer::FromStringEditable("", "")} {
+  lexer_.EnableLookaheadTracking(true);
+}
+
+void IncrementalLexer::SetText(const std::string& name, const std::string& text) {
+  source_ = SourceBuffer::FromStringEditable(name, text);
+  tokens_.Clear();
+  lookahead_ends_.clear();
+  mode_stack_ids_.clear();
+
+  lexer_.SetInput(source_);
+  Token token;
+  std::uint32_t mode_stack_id{InternModeStack(lexer_.GetModeStack())};
+  while (lexer_.GetNextToken(&token)) {
+    tokens_.Append(token);
+    lookahead_ends_.push_back(lexer_.GetLookaheadEnd());
+    mode_stack_ids_.push_back(mode_stack_id);
+    mode_stack_id = InternModeStack(lexer_.GetModeStack());
+  }
+  shift_first_ = tokens_.Size();
+  shift_ = 0;
+  max_lookahead_ends_.clear();
+  UpdateMaxLookaheadEnds(0);
+}
+
+RelexResult IncrementalLexer::ApplyEdit(const TextEdit& edit) {
+  const std::size_t size{source_->size()};
+  if (edit.offset > size || edit.removed > size - edit.offset) {
+    throw std::out_of_range(fmt::format("Edit of {} bytes at {} is outside {} bytes of {}",
+                                        edit.removed, edit.offset, size,
+                                        source_->GetFileName()));
+  }
+  const std::size_t edit_end{edit.offset + edit.removed};
+  const std::int64_t delta{static_cast<std::int64_t>(edit.inserted.size()) -
+                           static_cast<std::int64_t>(edit.removed)};
+
+  // The first token that read a byte of the edit or, for an insertion, the
+  // byte it is inserted before
+  std::size_t first{0};
+  std::size_t count{tokens_.Size()};
+  while (count > 0) {
+    const std::size_t half{count / 2};
+    if (GetMaxLookaheadEnd(first + half) <= edit.offset) {
+      first += half + 1;
+      count -= half + 1;
+    } else {
+      count = half;
+    }
+  }
+  std::size_t position{0};
+  std::vector<int> mode_stack;
+  if (first < tokens_.Size()) {
+    position = GetOffset(first);
+    mode_stack = mode_stacks_[mode_stack_ids_[first]];
+  } else if (!tokens_.Empty()) {
+    position = GetOffset(first - 1) + tokens_.Length(first - 1);
+    mode_stack = lexer_.GetModeStack();
+  }
+
+  // The lexer keeps reading the buffer it was given
+  source_->Splice(edit.offset, edit.removed, edit.inserted);
+  lexer_.InputEdited();
+  lexer_.Seek(position, mode_stack);
+
+  // Lex until a new token lines up with an old token past the edit
+  TokenBuffer relexed;
+  std::vector<std::size_t> relexed_lookahead_ends;
+  std::vector<std::uint32_t> relexed_mode_stack_ids;
+  std::size_t old{first};
+  Token token;
+  while (true) {
+    const std::uint32_t mode_stack_id{InternModeStack(lexer_.GetModeStack())};
+    while (old < tokens_.Size() &&
+           (GetOffset(old) < edit_end ||
+            static_cast<std::int64_t>(GetOffset(old)) + delta <
+            static_cast<std::int64_t>(position))) {
+      ++old;
+    }
+    if (old < tokens_.Size() &&
+        static_cast<std::int64_t>(GetOffset(old)) + delta ==
+        static_cast<std::int64_t>(position) &&
+        mode_stack_ids_[old] == mode_stack_id) {
+      break;
+    }
+
+    if (!lexer_.GetNextToken(&token)) {
+      // Lexed to the end of the text without lining up
+      old = tokens_.Size();
+      break;
+    }
+    relexed.Append(token);
+    relexed_lookahead_ends.push_back(lexer_.GetLookaheadEnd());
+    relexed_mode_stack_ids.push_back(mode_stack_id);
+    position += token.length;
+  }
+
+  // The old tokens from old on are kept; the edit only adds to the pending
+  // shift of their offsets
+  MoveShift(old);
+  shift_ += delta;
+  tokens_.Replace(first, old - first, relexed);
+  ReplaceRange(&lookahead_ends_, first, old - first, relexed_lookahead_ends);
+  ReplaceRange(&mode_stack_ids_, first, old - first, relexed_mode_stack_ids);
+  // The maxima of the relexed tokens are set by UpdateMaxLookaheadEnds
+  ReplaceRange(&max_lookahead_ends_, first, old - first, relexed_lookahead_ends);
+  shift_first_ = first + relexed.Size();
+  UpdateMaxLookaheadEnds(first);
+
+  return {first, old - first, relexed.Size()};
+}
+
+const TokenBuffer& IncrementalLexer::GetTokens() {
+  MoveShift(tokens_.Size());
+  return tokens_;
+}
+
+Token IncrementalLexer::GetToken(const std::size_t i) const {
+  Token token{tokens_.Get(i)};
+  token.offset = GetOffset(i);
+  return token;
+}
+
+std::uint32_t IncrementalLexer::InternModeStack(const std::vector<int>& mode_stack) {
+  const auto [it, inserted]{mode_stack_ids_by_stack_.emplace(
+    mode_stack, static_cast<std::uint32_t>(mode_stacks_.size()))};
+  if (inserted) {
+    mode_stacks_.push_back(mode_stack);
+  }
+  return it->second;
+}
+
+void IncrementalLexer::MoveShift(const std::size_t first) {
+  if (shift_ != 0 && first > shift_first_) {
+    tokens_.ShiftOffsets(shift_first_, first, shift_);
+    ShiftPositions(&lookahead_ends_, shift_first_, first, shift_);
+    ShiftPositions(&max_lookahead_ends_, shift_first_, first, shift_);
+  } else if (shift_ != 0 && first < shift_first_) {
+    tokens_.ShiftOffsets(first, shift_first_, -shift_);
+    ShiftPositions(&lookahead_ends_, first, shift_first_, -shift_);
+    ShiftPositions(&max_lookahead_ends_, first, shift_first_, -shift_);
+  }
+  shift_first_ = first;
+  if (shift_first_ == tokens_.Size()) {
+    shift_ = 0;
+  }
+}
+
+void IncrementalLexer::UpdateMaxLookaheadEnds(const std::size_t first) {
+  max_lookahead_ends_.resize(lookahead_ends_.size());
+  std::size_t max_end{first > 0 ? GetMaxLookaheadEnd(first - 1) : 0};
+  for (std::size_t i = first; i < lookahead_ends_.size(); ++i) {
+    max_end = std::max(max_end, GetLookaheadEnd(i));
+    if (i < shift_first_) {
+      max_lookahead_ends_[i] = max_end;
+      continue;
+    }
+    // Past an unchanged maximum, all the maxima are unchanged
+    if (GetMaxLookaheadEnd(i) == max_end) { break; }
+    max_lookahead_ends_[i] = static_cast<std::size_t>(max_end - shift_);
+  }
+}
@@ -0,0 +1,70 @@
+// Define the keyword table
+#include "lexer/keyword_table.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <fmt/format.h>
+
+// Seeds tried per table size before the table is doubled
+static constexpr std::uint32_t kSeedsPerSize{4096};
+
+static char FoldCase(const char c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+KeywordTable::KeywordTable(const std::vector<Keyword>& keywords) {
+  if (keywords.empty()) { return; }
+
+  std::vector<Keyword> folded{keywords};
+  min_length_ = folded.front().text.length();
+  for (auto& keyword : folded) {
+    std::transform(keyword.text.begin(), keyword.text.end(), keyword.text.begin(), FoldCase);
+    min_length_ = std::min(min_length_, keyword.text.length());
+    max_length_ = std::max(max_length_, keyword.text.length());
+  }
+
+  // Twice as many slots as keywords make a collision free seed quick to find
+  std::size_t num_slots{8};
+  while (num_slots < 2 * folded.size()) { num_slots *= 2; }
+
+  while (true) {
+    for (seed_ = 0; seed_ < kSeedsPerSize; ++seed_) {
+      slots_.assign(num_slots, Keyword{});
+      bool collision{false};
+      for (const auto& keyword : folded) {
+        Keyword& slot{slots_[Hash(keyword.text, seed_) & (num_slots - 1)]};
+        if (slot.value >= 0) {
+          if (slot.text == keyword.text) {
+            throw std::invalid_argument(fmt::format("Keyword {} is defined twice", keyword.text));
+          }
+          collision = true;
+          break;
+        }
+        slot = keyword;
+      }
+      if (!collision) { return; }
+    }
+    num_slots *= 2;
+  }
+}
+
+int KeywordTable::Find(const std::string_view text) const {
+  if (text.length() < min_length_ || text.length() > max_length_ || slots_.empty()) {
+    return -1;
+  }
+
+  const Keyword& slot{slots_[Hash(text, seed_) & (slots_.size() - 1)]};
+  if (slot.value < 0 || slot.text.length() != text.length()) { return -1; }
+  for (std::size_t i = 0; i < text.length(); ++i) {
+    if (FoldCase(text[i]) != slot.text[i]) { return -1; }
+  }
+  return slot.value;
+}
+
+std::uint32_t KeywordTable::Hash(const std::string_view text, const std::uint32_t seed) {
+  // FNV-1a of the folded text, offset by the seed
+  std::uint32_t hash{2166136261u ^ (seed * 0x9e3779b9u)};
+  for (const char c : text) {
+    hash = (hash ^ static_cast<unsigned char>(FoldCase(c))) * 16777619u;
+  }
+  return hash ^ (hash >> 16);
+}
@@ -6,92 +6,433 @@
 #include <stdexcept>
 #include <cassert>
 #include <stack>
+#include <algorithm>
 #include <cctype>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
 #include "lexer/lexer.hpp"
 #include "utils/string_utils.hpp"
 #include "utils/file_utils.hpp"
 #include "utils/file_location.hpp"
-
-static const std::string kErrorHeader{"LEXER"};
+#include "utils/buffered_writer.hpp"
+#include "utils/spsc_ring.hpp"
+#include "utils/trace.hpp"
+
+static const std::string kStdinFileName{"-"};
+
+// Automatons that run this many symbols past their last accepting state get
+// their run memoized. Shorter runs are cheaper to repeat than to record, and
+// repeating them costs at most a constant per buffer position.
+static constexpr std::size_t kMinFailedRunToMemoize{16};
+
+// The native automatons read at most this far for a lexeme. They cannot use
+// the memo of failed runs, so longer scans go to the tables.
+static constexpr std::size_t kMaxJitScan{1024};
+
+// Tokens RunLexerOn pulls per batch, and batches in flight between the
+// lexer and the writer when pipelined
+static constexpr std::size_t kBatchSize{4096};
+static constexpr std::size_t kPipelineBatches{8};
+
+// Error tokens echo at most this many bytes of unmatched input
+static constexpr std::size_t kMaxErrorTextLength{64};
+
+// Diagnostics of RunLexerOn
+static const DiagnosticKind kUnmatchedInput{"LEX001", Severity::ERROR, "Cannot identify token"};
+static const DiagnosticKind kUnmatchedCommentEnd{
+  "LEX002", Severity::ERROR, "Cannot match comment block parens"};
+static const DiagnosticKind kUnterminatedComment{
+  "LEX003", Severity::ERROR, "Cannot identify a matching end token"};
+// Indexed by LiteralError
+static const DiagnosticKind kLiteralErrors[]{
+  {"LEX100", Severity::ERROR, ""},
+  {"LEX101", Severity::ERROR, GetLiteralErrorMessage(LiteralError::INTEGER_TOO_LARGE)},
+  {"LEX102", Severity::ERROR, GetLiteralErrorMessage(LiteralError::STRING_TOO_LONG)},
+  {"LEX103", Severity::ERROR, GetLiteralErrorMessage(LiteralError::STRING_NULL)},
+  {"LEX104", Severity::ERROR, GetLiteralErrorMessage(LiteralError::STRING_ESCAPED_NULL)},
+  {"LEX105", Severity::ERROR, GetLiteralErrorMessage(LiteralError::STRING_UNTERMINATED)},
+  {"LEX106", Severity::ERROR, GetLiteralErrorMessage(LiteralError::STRING_EOF)},
+};
 
 Lexer::Lexer(const std::string& lexer_definition_file_name) :
-   lexer_definition_file_{lexer_definition_file_name},
-   token_regex_precedence_{GetTokenRegex()},
-   keyword_tokens_{GetKeywords()},
-   symbol_tokens_{GetSymbols()}{
+  Lexer{LexerSpec::Load(lexer_definition_file_name)} {
+}
+
+Lexer::Lexer(const std::shared_ptr<const LexerSpec>& spec) :
+  spec_{spec},
+  token_kinds_{spec_->GetTokenKinds()} {
   spdlog::info("Constructing a Lexer");
 
-  for (const auto& tok_reg : token_regex_precedence_) {
-    spdlog::debug("Token {} Regex {}", tok_reg.first, tok_reg.second);
+  ws_kind_ = token_kinds_.Find("WS");
+  comment_line_kind_ = token_kinds_.Find("COMMENT_LINE");
+  comment_block_start_kind_ = token_kinds_.Find("COMMENT_BLOCK_START");
+  comment_block_end_kind_ = token_kinds_.Find("COMMENT_BLOCK_END");
+  string_kind_ = token_kinds_.Find("STRING");
+  integer_kind_ = token_kinds_.Find("INTEGER");
+
+  symbol_tables_of_kind_.assign(token_kinds_.Size(), nullptr);
+  for (const char* const name : {"IDENTIFIER", "TYPE", "SELF_IDENTIFIER", "SELF_TYPE"}) {
+    const TokenKind kind{token_kinds_.Find(name)};
+    if (kind != kInvalidTokenKind) { symbol_tables_of_kind_[kind] = &SymbolTables::idtable; }
   }
-
-  for (const auto& kw : keyword_tokens_) {
-    spdlog::debug("Keyword {}", kw);
+  if (integer_kind_ != kInvalidTokenKind) {
+    symbol_tables_of_kind_[integer_kind_] = &SymbolTables::inttable;
   }
-
-  for (const auto& sym : symbol_tokens_) {
-    spdlog::debug("Symbol {}", sym);
+  if (string_kind_ != kInvalidTokenKind) {
+    symbol_tables_of_kind_[string_kind_] = &SymbolTables::stringtable;
   }
 
-  ConstructAutomatons();
+  BuildModes();
+  failed_runs_.resize(spec_->GetNumRules());
+}
+
+Lexer::~Lexer() = default;
+
+void Lexer::EnableJit(const bool enable) {
+  jit_requested_ = enable;
+  BuildModes();
+}
+
+void Lexer::EnableKeywordLookup(const bool enable) {
+  keyword_lookup_ = enable;
+  BuildModes();
 }
 
-Lexer::~Lexer() {
-  automatons_.clear();
+void Lexer::BuildModes() {
+  // The automatons are the spec's; only the scanning state is per lexer
+  std::size_t num_automatons{0};
+  jit_enabled_ = false;
+  modes_.assign(spec_->GetNumModes(), {});
+  for (std::size_t mode = 0; mode < modes_.size(); ++mode) {
+    for (const std::size_t rule : spec_->GetModeRules(mode, keyword_lookup_)) {
+      modes_[mode].rules.push_back(rule);
+      modes_[mode].automatons.push_back(&spec_->GetAutomaton(rule));
+      modes_[mode].state_offsets.push_back(spec_->GetStateOffset(rule));
+    }
+    for (const DFA* const automaton : modes_[mode].automatons) {
+      for (int byte = 0; byte < 256; ++byte) {
+        if (automaton->GetTransition(automaton->GetStartState(), static_cast<char>(byte)) >= 0) {
+          modes_[mode].start_bytes[byte] = true;
+        }
+      }
+    }
+    modes_[mode].jit = jit_requested_ ? spec_->GetJit(mode, keyword_lookup_) : nullptr;
+    jit_enabled_ = jit_enabled_ || modes_[mode].jit;
+    num_automatons = std::max(num_automatons, modes_[mode].automatons.size());
+  }
+  automaton_states_.assign(num_automatons, -1);
+  active_automatons_.reserve(num_automatons);
+  last_accept_ptrs_.assign(num_automatons, -1);
+  scan_end_ptrs_.assign(num_automatons, 0);
 }
 
 void Lexer::Reset() {
-  input_file_.clear();
-  input_file_buffer_.clear();
-  lexeme_ptr_ = -1;
+  source_.reset();
+  file_location_.reset();
+  stream_.reset();
+  lexeme_ptr_ = 0;
+  mode_stack_.clear();
+  lookahead_end_ = 0;
 }
 
 void Lexer::SetInputFile(const std::string& input_file) {
-  input_file_ = input_file;
-  input_file_buffer_ = ReadFile(input_file_);
-  lexeme_ptr_ = 0;
+  SetInput(SourceBuffer::FromFile(input_file));
+}
+
+void Lexer::SetInput(const std::shared_ptr<const SourceBuffer>& source) {
+  assert (source);
+
+  // Tokens address the buffer with 32-bit offsets
+  if (source->size() > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::length_error(fmt::format("{} is too large to lex", source->GetFileName()));
+  }
+
+  Reset();
+  source_ = source;
+  file_location_.reset(new FileLocation{source_});
+  ClearFailedRuns();
+}
+
+void Lexer::Seek(const std::size_t offset, const std::vector<int>& mode_stack) {
+  assert (source_ && offset <= source_->size());
+  lexeme_ptr_ = offset;
+  mode_stack_ = mode_stack;
 }
 
-void Lexer::RunLexerOn(const std::string& input_file) {
+void Lexer::InputEdited() {
+  assert (source_);
+  if (source_->size() > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::length_error(fmt::format("{} is too large to lex", source_->GetFileName()));
+  }
+  // The line index is rebuilt when it is next needed. Failed runs are only
+  // recorded when lookahead is not tracked.
+  file_location_.reset(new FileLocation{source_});
+  if (!track_lookahead_) {
+    ClearFailedRuns();
+  }
+}
+
+void Lexer::SetInputStream(const int fd, const std::string& name,
+                           const std::size_t chunk_size) {
+  Reset();
+  stream_.reset(new InputStream{fd, name, chunk_size});
+  ClearFailedRuns();
+}
+
+// Output state of RunLexerOn
+struct Lexer::RunOutput {
+  RunOutput(const std::string& input_file, const std::string& output_file,
+            const std::shared_ptr<const SourceBuffer>& source) :
+    diagnostics{std::make_shared<DiagnosticBuffer>(input_file, source)},
+    lexer_output{fmt::format("{}.cclex", output_file)} {
+  }
+
+  // Reported as they are found, rendered by the caller of RunLexerOn
+  std::shared_ptr<DiagnosticBuffer> diagnostics;
+  BufferedWriter lexer_output;
+  std::unique_ptr<TokenFileWriter> token_file;
+  // All the tokens, kept for the token cache
+  std::unique_ptr<TokenBuffer> cache_tokens;
+
+  // The line of each token is tracked through the text of the tokens, which
+  // tile the input
+  std::size_t line_no{0};
+  std::uint64_t line_start{0};
+
+  std::stack<InputPosition> comment_block_stack;
+
+  LexerRunSummary summary;
+};
+
+LexerRunSummary Lexer::RunLexerOn(const std::string& input_file) {
+  CC_TRACE_SPAN("RunLexerOn");
+
+  // Standard input is lexed as a stream
+  const bool from_stdin{input_file == kStdinFileName};
+  PhaseTime read_time;
+  {
+    const ScopedPhaseTimer timer{&read_time};
+    if (from_stdin) {
+      SetInputStream(STDIN_FILENO, input_file);
+    } else {
+      SetInputFile(input_file);
+    }
+  }
+  const std::string output_file{from_stdin ? "stdin" : input_file};
+
+  RunOutput output{input_file, output_file, source_};
+  output.summary.read_time = read_time;
+  output.summary.kind_counts.assign(token_kinds_.Size(), 0);
+  if (token_file_ && stream_) {
+    spdlog::warn("No token file for streamed input {}", input_file);
+  } else if (token_file_) {
+    output.token_file.reset(new TokenFileWriter{token_kinds_});
+  }
 
-  SetInputFile(input_file);
+  if (pipeline_ && stream_) {
+    // The tokens of a stream only live until the window moves
+    spdlog::info("Lexing streamed input {} without a pipeline", input_file);
+  }
+  // A hit is written like one batch of all the tokens
+  TokenCacheKey cache_key;
+  TokenBuffer cached;
+  if (token_cache_ && !stream_) {
+    const ScopedPhaseTimer timer{&output.summary.read_time};
+    cache_key = TokenCache::Key(*spec_, source_->View());
+    output.summary.cached = token_cache_->Load(cache_key, &cached);
+    if (!output.summary.cached) {
+      output.cache_tokens.reset(new TokenBuffer);
+    }
+  }
 
-  // Setup error handler
-  if (error_handlers_.find(input_file) == error_handlers_.end()) {
-    error_handlers_.insert({input_file, ErrorHandler{kErrorHeader, input_file}});
+  if (output.summary.cached) {
+    {
+      const ScopedPhaseTimer timer{&output.summary.lex_time};
+      InternSymbols(&cached, 0);
+    }
+    WriteBatch(cached, &output);
+  } else if (pipeline_ && !stream_) {
+    RunPipeline(&output);
+  } else {
+    TokenBuffer batch;
+    while (TimedNextBatch(&batch, &output.summary.lex_time)) {
+      WriteBatch(batch, &output);
+    }
   }
-  ErrorHandler& error_handler{error_handlers_.at(input_file)};
 
-  std::stack<int> comment_block_stack;
+  if (!output.comment_block_stack.empty()) {
+    // we never encountered a comment_block_end
+    ReportDiagnostic(kUnterminatedComment, output.comment_block_stack.top(), 0, &output);
+    ++output.summary.num_errors;
+  }
+  output.diagnostics->Finish();
+  output.summary.diagnostics = std::move(output.diagnostics);
+
+  {
+    const ScopedPhaseTimer timer{&output.summary.write_time};
+    output.lexer_output.Flush();
+    if (output.token_file) {
+      output.token_file->Write(fmt::format("{}.cctok", output_file));
+    }
+    if (output.cache_tokens) {
+      token_cache_->Store(cache_key, *output.cache_tokens);
+    }
+  }
 
-  std::string lexer_output;
-  Lexeme lexeme;
-  while (GetNextLexeme(&lexeme)) {
-    if (lexeme.lexeme.empty() && comment_block_stack.empty()) {
-      // Write error to console
-      error_handler.ConsolePrint(lexeme.file_location_info.buf_idx, "Cannot identify token");
+  Reset();
+
+  return output.summary;
+}
+
+void Lexer::RunPipeline(RunOutput* const output) {
+  // Batches cycle from the lexer thread to this one through filled and back
+  // through empty. The lexer waits for an empty batch when the writer falls
+  // behind.
+  std::vector<TokenBuffer> batches(kPipelineBatches);
+  SpscRing<TokenBuffer*> filled{kPipelineBatches};
+  SpscRing<TokenBuffer*> empty{kPipelineBatches};
+  for (auto& batch : batches) {
+    empty.Push(&batch);
+  }
+
+  // The lexer thread times itself; the writer does not touch lex_time
+  std::exception_ptr lexer_error;
+  PhaseTime* const lex_time{&output->summary.lex_time};
+  std::thread lexer_thread{[this, &filled, &empty, &lexer_error, lex_time]() {
+    try {
+      TokenBuffer* batch{nullptr};
+      while (empty.Pop(&batch) && TimedNextBatch(batch, lex_time)) {
+        filled.Push(batch);
+      }
+    } catch (...) {
+      lexer_error = std::current_exception();
+    }
+    filled.Close();
+  }};
+
+  // The writer only reads the input, which the lexer does not change
+  try {
+    TokenBuffer* batch{nullptr};
+    while (filled.Pop(&batch)) {
+      WriteBatch(*batch, output);
+      empty.Push(batch);
+    }
+  } catch (...) {
+    empty.Close();
+    lexer_thread.join();
+    throw;
+  }
+  empty.Close();
+  lexer_thread.join();
+
+  if (lexer_error) {
+    std::rethrow_exception(lexer_error);
+  }
+}
+
+// Write text as the reference lexer prints strings: printable characters
+// as they are, the others as C escapes
+static void WriteEscaped(const std::string_view text, BufferedWriter* const out) {
+  for (const char c : text) {
+    switch (c) {
+    case '\\': out->Write("\\\\"); break;
+    case '"': out->Write("\\\""); break;
+    case '\n': out->Write("\\n"); break;
+    case '\t': out->Write("\\t"); break;
+    case '\b': out->Write("\\b"); break;
+    case '\f': out->Write("\\f"); break;
+    default:
+      if (std::isprint(static_cast<unsigned char>(c))) {
+        out->Write(c);
+      } else {
+        out->Write(fmt::format("\\{:03o}", static_cast<unsigned char>(c)));
+      }
+    }
+  }
+}
+
+std::size_t Lexer::TimedNextBatch(TokenBuffer* const tokens, PhaseTime* const lex_time) {
+  const ScopedPhaseTimer timer{lex_time};
+  return NextBatch(tokens, kBatchSize);
+}
+
+void Lexer::WriteBatch(const TokenBuffer& batch, RunOutput* const output) const {
+  const ScopedPhaseTimer timer{&output->summary.write_time};
+  BufferedWriter& lexer_output{output->lexer_output};
+  std::stack<InputPosition>& comment_block_stack{output->comment_block_stack};
+
+  // Read once per batch - when pipelined, the lexer thread keeps writing to
+  // the members around these
+  const std::string_view input{GetInputView()};
+  const std::uint64_t input_base{stream_ ? stream_->GetBase() : 0};
+  const TokenKind ws_kind{ws_kind_};
+  const TokenKind comment_line_kind{comment_line_kind_};
+  const TokenKind comment_block_start_kind{comment_block_start_kind_};
+  const TokenKind comment_block_end_kind{comment_block_end_kind_};
+  const TokenKind string_kind{string_kind_};
+
+  if (output->cache_tokens) {
+    output->cache_tokens->Append(batch);
+  }
+  std::size_t* const kind_counts{output->summary.kind_counts.data()};
+
+  for (std::size_t i = 0; i < batch.Size(); ++i) {
+    const Token token{batch.Get(i)};
+    const TokenKind kind{token.kind};
+    if (kind != kInvalidTokenKind) { ++kind_counts[kind]; }
+    const InputPosition position{input_base + token.offset, output->line_no, output->line_start};
+    const std::string_view text{input.substr(token.offset, token.length)};
+    output->summary.num_bytes = position.offset + token.length;
+    for (std::size_t nl = text.find('\n'); nl != std::string_view::npos;
+         nl = text.find('\n', nl + 1)) {
+      ++output->line_no;
+      output->line_start = position.offset + nl + 1;
+    }
+
+    if (kind == kInvalidTokenKind && comment_block_stack.empty()) {
+      const bool bad_literal{token.symbol != kNoSymbol};
+      const DiagnosticKind& diagnostic{bad_literal ? kLiteralErrors[token.symbol] : kUnmatchedInput};
+      ReportDiagnostic(diagnostic, position, token.length, output);
+      ++output->summary.num_errors;
+
+      // An error token, on the line the literal ends on as in the reference
+      // lexer - an unterminated string ends before its newline. Unmatched
+      // input is echoed escaped.
+      const bool ends_line{!text.empty() && text.back() == '\n'};
+      lexer_output.WriteNumber(bad_literal ? output->line_no + (ends_line ? 0 : 1)
+                                           : position.line_no + 1);
+      lexer_output.Write("\nerror\n");
+      if (bad_literal) {
+        lexer_output.Write(diagnostic.format);
+      } else {
+        WriteEscaped(text.substr(0, kMaxErrorTextLength), &lexer_output);
+        if (text.length() > kMaxErrorTextLength) { lexer_output.Write("..."); }
+      }
+      lexer_output.Write('\n');
       continue;
     }
 
     // ignore whitespaces and comment line
-    if (lexeme.token == "WS" ||
-        lexeme.token == "COMMENT_LINE") {
+    if (kind == ws_kind ||
+        kind == comment_line_kind) {
       continue;
     }
 
-    if (lexeme.token == "COMMENT_BLOCK_END" && comment_block_stack.empty()) {
-      error_handler.ConsolePrint(lexeme.file_location_info.buf_idx,
-                                 "Cannot match comment block parens");
+    if (kind == comment_block_end_kind && comment_block_stack.empty()) {
+      ReportDiagnostic(kUnmatchedCommentEnd, position, token.length, output);
+      ++output->summary.num_errors;
       continue;
     }
 
     // Is this a comment
-    if (lexeme.token == "COMMENT_BLOCK_START") {
-      comment_block_stack.push(lexeme.file_location_info.buf_idx);
+    if (kind == comment_block_start_kind) {
+      comment_block_stack.push(position);
       continue;
     }
 
-    if (lexeme.token == "COMMENT_BLOCK_END") {
+    if (kind == comment_block_end_kind) {
       comment_block_stack.pop();
       continue;
     }
@@ -101,347 +442,560 @@ void Lexer::RunLexerOn(const std::string& input_file) {
       continue;
     }
 
+    // A string is on the line it ends on, as in the reference lexer
+    const std::size_t line_no{kind == string_kind ? output->line_no : position.line_no};
+    if (output->token_file) {
+      output->token_file->Append(kind, token.offset, line_no, text);
+    }
 
-    std::string token_lower;
-    std::transform(lexeme.token.begin(), lexeme.token.end(),
-                   std::back_inserter(token_lower),
-                   [](const char x) { return std::tolower(x); });
-
-    lexer_output = fmt::format("{}{}\n", lexer_output, lexeme.file_location_info.line_no + 1);
-    lexer_output = fmt::format("{}{}\n", lexer_output, token_lower);
+    ++output->summary.num_tokens;
+    lexer_output.WriteNumber(line_no + 1);
+    lexer_output.Write('\n');
+    lexer_output.Write(token_kinds_.Get(kind).lower_name);
+    lexer_output.Write('\n');
 
-    const bool is_keyword{keyword_tokens_.find(lexeme.token) != keyword_tokens_.end()};
-    const bool is_symbol{symbol_tokens_.find(lexeme.token) != symbol_tokens_.end()};
-    if (!is_keyword && !is_symbol) {
-      if (lexeme.token == "STRING") {
+    if (token_kinds_.HasLexeme(kind)) {
+      if (kind == string_kind) {
         // remove enclosing quotes
-        lexer_output = fmt::format("{}{}\n", lexer_output, lexeme.lexeme.substr(1, lexeme.lexeme.length() - 2));
+        lexer_output.Write(text.substr(1, text.length() - 2));
       } else {
-        lexer_output = fmt::format("{}{}\n", lexer_output, lexeme.lexeme);
+        lexer_output.Write(text);
       }
+      lexer_output.Write('\n');
     }
   }
+}
 
-  if (!comment_block_stack.empty()) {
-    // we never encountered a comment_block_end
-    error_handler.ConsolePrint(
-      comment_block_stack.top(), "Cannot idenitfy a matching end token");
+bool Lexer::GetNextToken(Token* const token) {
+  assert (token);
+
+  if (stream_) {
+    if (!GetNextStreamToken(token)) { return false; }
+  } else if (source_ && lexeme_ptr_ < source_->size()) {
+    *token = ScanSourceToken();
+  } else {
+    return false;
   }
 
-  // write string to output file
-  WriteToFile(fmt::format("{}.cclex", input_file), lexer_output);
+  if (symbol_tables_ && token->kind != kInvalidTokenKind) {
+    const std::lock_guard<std::mutex> lock{symbol_tables_->mutex};
+    std::string decoded;
+    token->symbol = InternSymbol(*token, GetInputView(), &decoded);
+  }
+  return true;
+}
 
-  Reset();
+Token Lexer::ScanSourceToken() {
+  assert (lexeme_ptr_ < source_->size());
+
+  // Match lexeme; unmatched input is consumed one character at a time
+  int rule{kNoRule};
+  const std::size_t length{MatchAt(source_->data(), source_->size(), lexeme_ptr_, &rule)};
+  rule = LookupKeyword(rule, source_->data() + lexeme_ptr_, length);
+  Token token{AcceptRule(rule), static_cast<std::uint32_t>(lexeme_ptr_),
+              static_cast<std::uint32_t>(rule == kNoRule ? 1 : length)};
+  CheckLiteral(source_->View(), true, &token);
+  if (token.kind == kInvalidTokenKind && token.symbol == kNoSymbol) {
+    // One token for the whole run of unmatched input
+    token.length = static_cast<std::uint32_t>(
+      ErrorRunLength(source_->data(), source_->size(), lexeme_ptr_, nullptr));
+  }
+  lexeme_ptr_ += token.length;
+  return token;
+}
 
+std::size_t Lexer::ErrorRunLength(const char* const buffer, const std::size_t buflen,
+                                  const std::size_t start, bool* const reached_end) {
+  const std::array<bool, 256>& start_bytes{modes_[GetMode()].start_bytes};
+  const bool stop_at_quote{string_kind_ != kInvalidTokenKind};
+  std::size_t lookahead_end{lookahead_end_};
+  if (reached_end) { *reached_end = false; }
+
+  std::size_t end{start + 1};
+  while (true) {
+    // Bytes no automaton starts on are skipped without running one
+    while (end < buflen && !start_bytes[static_cast<unsigned char>(buffer[end])]) {
+      ++end;
+    }
+    if (end == buflen) {
+      if (reached_end) { *reached_end = true; }
+      break;
+    }
+    if (stop_at_quote && buffer[end] == '"') { break; }
+
+    int rule{kNoRule};
+    bool match_reached_end{false};
+    if (reached_end) {
+      MatchAtTable(buffer, buflen, end, &rule, &match_reached_end);
+    } else {
+      MatchAt(buffer, buflen, end, &rule);
+    }
+    lookahead_end = std::max(lookahead_end, lookahead_end_);
+    if (match_reached_end) { *reached_end = true; }
+    if (rule != kNoRule || match_reached_end) { break; }
+    ++end;
+  }
+
+  lookahead_end_ = std::max(lookahead_end, end + 1);
+  return end - start;
 }
 
-bool Lexer::GetNextLexeme(Lexeme* const lexeme) {
-  assert (lexeme);
+bool Lexer::CheckLiteral(const std::string_view buffer, const bool at_end, Token* const token) {
+  const std::string_view input{buffer.substr(token->offset)};
+
+  // A quote no rule matched starts a string too - it breaks a rule, or has
+  // characters the automatons do not know
+  if (token->kind == string_kind_ ||
+      (token->kind == kInvalidTokenKind && input.front() == '"' &&
+       string_kind_ != kInvalidTokenKind)) {
+    const StringLiteral literal{ScanStringLiteral(input)};
+    if (literal.reached_end && !at_end) { return false; }
+    token->length = static_cast<std::uint32_t>(literal.length);
+    if (literal.error == LiteralError::NONE) {
+      token->kind = string_kind_;
+    } else {
+      token->kind = kInvalidTokenKind;
+      token->symbol = static_cast<SymbolId>(literal.error);
+    }
+    if (track_lookahead_) {
+      lookahead_end_ = std::max(lookahead_end_, token->offset + literal.length +
+                                (literal.reached_end ? 1 : 0));
+    }
+    return true;
+  }
 
-  // setup file location
-  if (file_locations_.find(input_file_) == file_locations_.end()) {
-    file_locations_.insert({input_file_, FileLocation{input_file_}});
+  std::int32_t value{0};
+  if (token->kind == integer_kind_ && !DecodeInteger(input.substr(0, token->length), &value)) {
+    token->kind = kInvalidTokenKind;
+    token->symbol = static_cast<SymbolId>(LiteralError::INTEGER_TOO_LARGE);
   }
-  FileLocation& file_location{file_locations_.at(input_file_)};
+  return true;
+}
 
-  const std::size_t buflen{input_file_buffer_.length()};
+std::size_t Lexer::NextBatch(TokenBuffer* const tokens, const std::size_t max_tokens) {
+  assert (tokens);
 
-  if (lexeme_ptr_ >= static_cast<int>(buflen)) {
-    return false;
+  // Clear keeps the capacity of the buffer
+  tokens->Clear();
+
+  if (stream_) {
+    // Only the first token of a batch may move the window
+    Token token;
+    while (tokens->Size() < max_tokens && GetNextStreamToken(&token, tokens->Empty())) {
+      tokens->Append(token);
+    }
+    InternSymbols(tokens, 0);
+    return tokens->Size();
   }
 
-  // Match lexeme
-  std::string lexeme_text;
-  std::string token;
-  const int lexeme_test_idx{lexeme_ptr_};
-  lexeme_ptr_ = GetLexemeAt(input_file_buffer_, lexeme_ptr_, &lexeme_text, &token);
-  *lexeme = Lexeme{lexeme_text, token, file_location.GetFileLocationInfo(lexeme_test_idx)};
+  if (!source_) { return 0; }
+  const std::size_t size{source_->size()};
+  while (tokens->Size() < max_tokens && lexeme_ptr_ < size) {
+    tokens->Append(ScanSourceToken());
+  }
+  InternSymbols(tokens, 0);
+  return tokens->Size();
+}
 
-  return true;
+void Lexer::InternSymbols(TokenBuffer* const tokens, const std::size_t first) const {
+  if (!symbol_tables_) { return; }
+
+  // One lock per batch
+  const std::lock_guard<std::mutex> lock{symbol_tables_->mutex};
+  const std::string_view input{GetInputView()};
+  std::string decoded;
+  for (std::size_t i = first; i < tokens->Size(); ++i) {
+    const Token token{tokens->Get(i)};
+    // Invalid tokens keep their LiteralError
+    if (token.kind != kInvalidTokenKind) {
+      tokens->SetSymbol(i, InternSymbol(token, input, &decoded));
+    }
+  }
 }
 
+SymbolId Lexer::InternSymbol(const Token& token, const std::string_view input,
+                             std::string* const decoded) const {
+  assert (token.kind != kInvalidTokenKind);
+  const auto table{symbol_tables_of_kind_[token.kind]};
+  if (!table) { return kNoSymbol; }
 
-void Lexer::ConstructAutomatons() {
-  spdlog::debug("#Tokens and Regex {}", token_regex_precedence_.size());
+  const std::string_view text{input.substr(token.offset, token.length)};
+  if (token.kind == string_kind_) {
+    ScanStringLiteral(text, decoded);
+    return symbol_tables_->stringtable.Intern(*decoded);
+  }
 
-  for (const auto& tr : token_regex_precedence_) {
-    spdlog::debug("{} - {}", tr.first, tr.second);
-    auto dfa{std::make_shared<DFA>(tr.second)};
-    automatons_.insert({tr.first, dfa});
-    // TODO For some reason the following gives an error !!
-    //automatons_.insert({tr.first, std::make_shared<DFA>(tr.second)});
+  SymbolTable& symbols{(*symbol_tables_).*table};
+  const SymbolId symbol{symbols.Intern(text)};
+  if (token.kind == integer_kind_ && symbol == symbol_tables_->integers.size()) {
+    // In range - CheckLiteral let the token through
+    std::int32_t value{0};
+    DecodeInteger(text, &value);
+    symbol_tables_->integers.push_back(value);
   }
+  return symbol;
 }
 
-int Lexer::GetLexemeAt(const std::string& buffer,
-		       const std::size_t lexeme_ptr,
-                       std::string* const lexeme,
-                       std::string* const token) {
-  assert (lexeme);
-  assert (token);
-
-  // Reset lexeme
-  *lexeme = std::string{};
-  *token = std::string{};
+int Lexer::LookupKeyword(const int rule, const char* const lexeme,
+                         const std::size_t length) const {
+  if (!keyword_lookup_ || rule == kNoRule) { return rule; }
 
-  std::unordered_map<std::string, std::shared_ptr<DFA>> tokens_automatons{automatons_};
+  // A keyword beats the rule that matched the same text only if it comes
+  // first, as it would running its own automaton
+  const int keyword{spec_->FindKeyword(GetMode(), {lexeme, length})};
+  return (keyword >= 0 && keyword < rule) ? keyword : rule;
+}
 
-  auto reset_dfas = [&]() {
-    for (auto& token_automaton : automatons_) {
-      token_automaton.second->Reset();
-    }
-  };
+TokenKind Lexer::AcceptRule(const int rule) {
+  if (rule == kNoRule) { return kInvalidTokenKind; }
+
+  switch (spec_->GetRule(rule).action) {
+  case ModeAction::NONE:
+    break;
+  case ModeAction::PUSH:
+    mode_stack_.push_back(spec_->GetRulePushMode(rule));
+    break;
+  case ModeAction::POP:
+    if (!mode_stack_.empty()) { mode_stack_.pop_back(); }
+    break;
+  }
+  return spec_->GetRuleKind(rule);
+}
 
-  auto move_dfas_on_symbol = [&](const char symbol) {
-    for (auto& token_automaton : tokens_automatons) {
-      token_automaton.second->MoveOnSymbol(symbol);
-    }
-  };
+bool Lexer::GetNextStreamToken(Token* const token, const bool may_refill) {
+  assert (stream_);
 
-  auto remove_error_dfas = [&]() {
-    // find error dfas
-    std::vector<std::string> error_tokens;
-    for (const auto& token_automaton : tokens_automatons) {
-      if (token_automaton.second->InErrorState()) {
-	error_tokens.emplace_back(token_automaton.first);
+  while (true) {
+    if (lexeme_ptr_ == stream_->size()) {
+      // Window used up
+      if (!may_refill || !RefillStream()) {
+        return false;
       }
+      continue;
     }
 
-    for (const auto& error_token : error_tokens) {
-      tokens_automatons.erase(tokens_automatons.find(error_token));
-    }
-  };
-
-  auto tokens_in_accepting_state = [&]() -> std::set<std::string> {
-    std::set<std::string> accepting_tokens;
-    for (const auto& token_automaton : tokens_automatons) {
-      if (token_automaton.second->InAcceptingState()) {
-	accepting_tokens.insert(token_automaton.first);
+    int rule{kNoRule};
+    bool reached_end{false};
+    const std::size_t length{MatchAtTable(stream_->data(), stream_->size(), lexeme_ptr_,
+                                          &rule, &reached_end)};
+    if (reached_end && !stream_->AtEnd()) {
+      // The lexeme may go on past the window - read more and match again
+      if (!may_refill) {
+        // Runs that died at the end of the window are not failures
+        ClearFailedRuns();
+        return false;
       }
+      RefillStream();
+      continue;
     }
-    return accepting_tokens;
-  };
 
-  auto get_top_token_in_accepting_state = [&](const std::set<std::string>& accepting_state_tokens) -> std::string {
-    for (const auto& token_regex : token_regex_precedence_) {
-      if (accepting_state_tokens.find(token_regex.first) != accepting_state_tokens.end()) {
-        return token_regex.first;
+    rule = LookupKeyword(rule, stream_->data() + lexeme_ptr_, length);
+    assert (lexeme_ptr_ <= std::numeric_limits<std::uint32_t>::max());
+    Token matched{rule == kNoRule ? kInvalidTokenKind : spec_->GetRuleKind(rule),
+                  static_cast<std::uint32_t>(lexeme_ptr_),
+                  static_cast<std::uint32_t>(rule == kNoRule ? 1 : length)};
+    if (!CheckLiteral({stream_->data(), stream_->size()}, stream_->AtEnd(), &matched)) {
+      // The string may go on past the window
+      if (!may_refill) { return false; }
+      RefillStream();
+      continue;
+    }
+    if (matched.kind == kInvalidTokenKind && matched.symbol == kNoSymbol) {
+      bool run_reached_end{false};
+      matched.length = static_cast<std::uint32_t>(
+        ErrorRunLength(stream_->data(), stream_->size(), lexeme_ptr_, &run_reached_end));
+      if (run_reached_end && !stream_->AtEnd()) {
+        // The run may go on past the window
+        if (!may_refill) {
+          ClearFailedRuns();
+          return false;
+        }
+        RefillStream();
+        continue;
       }
     }
-    return {};
-  };
-
-  struct LastMatch {
-    int last_match_ptr{-1};
-    std::set<std::string> match_tokens;
-  };
-
-  // Initialize last match to invalid state
-  LastMatch last_match;
-  const std::size_t buflen{buffer.length()};
-  assert (lexeme_ptr < buflen);
-  std::size_t forward_ptr{lexeme_ptr};
+    AcceptRule(rule);
+    *token = matched;
+    lexeme_ptr_ += token->length;
+    return true;
+  }
+}
 
-  // Reset dfa before start
-  reset_dfas();
+bool Lexer::RefillStream() {
+  // Keep the current lexeme, release what is before it
+  const bool read{stream_->Refill(stream_->GetBase() + lexeme_ptr_)};
+  lexeme_ptr_ = 0;
+  ClearFailedRuns();
+  // Tokens address the window with 32-bit offsets
+  if (stream_->size() > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::length_error(fmt::format("A lexeme of {} is too large to lex",
+                                        stream_->GetFileName()));
+  }
+  return read;
+}
 
-  while (forward_ptr < buflen) {
-    const char symbol{buffer.at(forward_ptr)};
+void Lexer::ClearFailedRuns() {
+  // Failed runs are specific to a buffer
+  for (FailedRuns& failed : failed_runs_) {
+    failed.begin = 0;
+    failed.states.clear();
+    failed.more.clear();
+  }
+}
 
-    // Move dfas
-    move_dfas_on_symbol(symbol);
+void Lexer::Tokenize(TokenBuffer* const tokens) {
+  assert (tokens);
+  // Streamed tokens are only valid until the window moves
+  assert (!stream_);
 
-    // Remove all dfas in error state
-    remove_error_dfas();
-    // If there are no dfas left - breakout
-    if (tokens_automatons.empty()) { break; }
+  const std::size_t first{tokens->Size()};
+  while (source_ && lexeme_ptr_ < source_->size()) {
+    tokens->Append(ScanSourceToken());
+  }
+  InternSymbols(tokens, first);
+}
 
-    // Get all tokens that are in accepting state
-    const auto accepting_tokens{tokens_in_accepting_state()};
+std::string_view Lexer::GetTokenText(const Token& token) const {
+  if (token.kind == kInvalidTokenKind) { return {}; }
+  return GetInputView().substr(token.offset, token.length);
+}
 
-    if (!accepting_tokens.empty()) {
-      // Update last match
-      last_match = LastMatch{static_cast<int>(forward_ptr), accepting_tokens};
-    }
+std::uint64_t Lexer::GetTokenPosition(const Token& token) const {
+  return (stream_ ? stream_->GetBase() : 0) + token.offset;
+}
 
-    forward_ptr++;
+std::string_view Lexer::GetInputView() const {
+  if (stream_) {
+    return {stream_->data(), stream_->size()};
   }
+  return source_ ? source_->View() : std::string_view{};
+}
 
-  // Reset dfa after processing
-  reset_dfas();
+bool Lexer::GetNextLexeme(Lexeme* const lexeme) {
+  assert (lexeme);
 
-  // If there has been no match - throw error
-  if (last_match.last_match_ptr == -1) {
-    spdlog::debug(fmt::format("No match for lexeme @ {} -{})",
-                              lexeme_ptr,
-                              buffer.substr(lexeme_ptr,  30)));
-    return lexeme_ptr + 1;
-  } else {
-    // Update output lexeme
-    assert (last_match.last_match_ptr >= static_cast<int>(lexeme_ptr));
-    assert (!last_match.match_tokens.empty());
-    *lexeme = buffer.substr(lexeme_ptr,
-                            last_match.last_match_ptr - lexeme_ptr + 1);
-    *token = get_top_token_in_accepting_state(last_match.match_tokens);
-    spdlog::debug(fmt::format("lexeme @ {} - ({}, {})",
-                              lexeme_ptr, *lexeme, *token));
-    return last_match.last_match_ptr + 1;
+  Token token;
+  if (!GetNextToken(&token)) {
+    return false;
   }
-}
 
-// Lexer Definition File read utilities
-#define COMMENT_START "//"
-#define DEFINITION_START "DEFINITION"
-#define KEYWORD_START "KEYWORDS"
-#define SYMBOL_START "SYMBOLS"
-#define TOKEN_REGEX_SEP ':'
+  *lexeme = Lexeme{std::string{GetTokenText(token)}, token.kind, token.offset};
 
-static bool IsLexDefComment(const std::string& s) {
-  // A comment starts with "//"
-  const std::string comment_start(COMMENT_START);
-  if (s.length() < comment_start.length()) { return false; }
-  if (s.substr(0, comment_start.length()) == comment_start) { return true; }
-  return false;
+  return true;
 }
 
-static bool IsLexDefDefinitionStartLine(const std::string& s) {
-  const std::string def_start(DEFINITION_START);
-  // The definitions start with "DEFINITIONS"
-  if (s.length() < def_start.length()) { return false; }
-  if (s.substr(0, def_start.length()) == def_start) { return true; }
-  return false;
+FileLocationInfo Lexer::GetFileLocationInfo(const std::uint32_t offset) const {
+  assert (file_location_);
+  return file_location_->GetFileLocationInfo(offset);
 }
 
-static bool IsLexDefKeywordStartLine(const std::string& s) {
-  const std::string kw_start(KEYWORD_START);
-  // The definitions start with "KEYWORDS"
-  if (s.length() < kw_start.length()) { return false; }
-  if (s.substr(0, kw_start.length()) == kw_start) { return true; }
-  return false;
+void Lexer::ReportDiagnostic(const DiagnosticKind& kind, const InputPosition& position,
+                             const std::size_t length, RunOutput* const output) const {
+  output->diagnostics->Report(kind, position.offset, static_cast<std::uint32_t>(position.line_no),
+                              static_cast<std::uint32_t>(position.offset - position.line_start),
+                              static_cast<std::uint32_t>(length));
+  if (!stream_) {
+    return;
+  }
+
+  // A stream only holds its window - the line text is kept when the line
+  // starts in it
+  if (position.line_start >= stream_->GetBase() &&
+      position.line_start <= stream_->GetBase() + stream_->size()) {
+    const std::string_view line{GetInputView().substr(position.line_start - stream_->GetBase())};
+    output->diagnostics->KeepLineText(line.substr(0, line.find('\n')));
+  }
 }
 
-static bool IsLexDefSymbolStartLine(const std::string& s) {
-  const std::string symbol_start(SYMBOL_START);
-  // The definitions start with "SYMBOLS"
-  if (s.length() < symbol_start.length()) { return false; }
-  if (s.substr(0, symbol_start.length()) == symbol_start) { return true; }
-  return false;
+std::size_t Lexer::MatchAt(const char* const buffer,
+                           const std::size_t buflen,
+                           const std::size_t lexeme_ptr,
+                           int* const rule) {
+  if (modes_[GetMode()].jit && !track_lookahead_) {
+    return MatchAtJit(buffer, buflen, lexeme_ptr, rule);
+  }
+  return MatchAtTable(buffer, buflen, lexeme_ptr, rule, nullptr);
 }
 
-std::vector<std::pair<std::string, std::string>> Lexer::GetTokenRegex() {
+std::size_t Lexer::MatchAtTable(const char* const buffer,
+                                const std::size_t buflen,
+                                const std::size_t lexeme_ptr,
+                                int* const rule,
+                                bool* const reached_end) {
+  assert (rule);
 
-  std::vector<std::pair<std::string, std::string>> token_regex;
-  const std::vector<std::string> lex_def_lines{ReadFileLines(lexer_definition_file_)};
+  *rule = kNoRule;
 
-  bool expect_token_regex{false};
-  for (const std::string& line : lex_def_lines) {
-    const std::string trimmed{Trim(line)};
+  // Only the automatons of the current mode run
+  const int mode{GetMode()};
+  const std::vector<const DFA*>& automatons{modes_[mode].automatons};
 
-    // ignore if it is a comment
-    if (IsLexDefComment(trimmed)) { continue; }
+  assert (lexeme_ptr < buflen);
+  assert (buffer[buflen] == SourceBuffer::kSentinel);
+  const std::string_view buffer_view{buffer, buflen};
+
+  // Reset automatons before start
+  active_automatons_.clear();
+  for (std::size_t i = 0; i < automatons.size(); ++i) {
+    automaton_states_[i] = automatons[i]->GetStartState();
+    last_accept_ptrs_[i] = -1;
+    active_automatons_.push_back(i);
+  }
 
-    if (expect_token_regex) {
-      // Make sure that the section hasn't ended
-      expect_token_regex = !IsLexDefKeywordStartLine(trimmed) && !IsLexDefSymbolStartLine(trimmed);
-    }
+  // Initialize last match to invalid state
+  long last_match_ptr{-1};
+  std::size_t last_match_automaton{0};
+  std::size_t forward_ptr{lexeme_ptr};
 
-    if (!expect_token_regex) {
-      auto defs_start_line = IsLexDefDefinitionStartLine(trimmed);
-      if (defs_start_line) {
-        spdlog::debug("Definitions start encountered...");
+  // No automaton moves on the sentinel - the loop ends at the end of the
+  // buffer without a bounds check
+  while (!active_automatons_.empty()) {
+    const char symbol{buffer[forward_ptr]};
+
+    // Move automatons; drop those that die or are known not to accept from
+    // here. active_automatons_ stays in precedence order, so the first
+    // accepting automaton is the top token.
+    bool accepting{false};
+    std::size_t num_alive{0};
+    for (const std::size_t idx : active_automatons_) {
+      const int state{automatons[idx]->GetTransition(automaton_states_[idx], symbol)};
+      if (state < 0 || (!track_lookahead_ && IsFailedState(mode, idx, state, forward_ptr))) {
+        scan_end_ptrs_[idx] = forward_ptr;
+        continue;
+      }
+      automaton_states_[idx] = state;
+      active_automatons_[num_alive++] = idx;
+
+      if (automatons[idx]->IsAcceptingState(state)) {
+        last_accept_ptrs_[idx] = static_cast<long>(forward_ptr);
+        if (!accepting) {
+          // Update last match
+          accepting = true;
+          last_match_ptr = static_cast<long>(forward_ptr);
+          last_match_automaton = idx;
+        }
       }
-      expect_token_regex = defs_start_line;
-      continue;
     }
+    active_automatons_.resize(num_alive);
 
-    // Parse token : regex
-    const std::size_t separator_pos{trimmed.find_first_of(TOKEN_REGEX_SEP)};
-    if (separator_pos == std::string::npos) {
-      spdlog::error(fmt::format("Cannot find TOKEN_REGEX_SEPARATOR {}", trimmed));
-      continue;
+    forward_ptr++;
+
+    // A lone automaton in a state that loops on a class of bytes - a
+    // whitespace run, a comment or a string body - skips the whole run at
+    // once
+    if (num_alive == 1) {
+      const std::size_t idx{active_automatons_.front()};
+      const int state{automaton_states_[idx]};
+      const ByteClass* const loop{spec_->GetSelfLoop(modes_[mode].state_offsets[idx] + state)};
+      if (loop) {
+        const std::size_t run_end{SkipByteClass(buffer_view, forward_ptr, *loop)};
+        if (run_end > forward_ptr && automatons[idx]->IsAcceptingState(state)) {
+          last_accept_ptrs_[idx] = static_cast<long>(run_end - 1);
+          last_match_ptr = static_cast<long>(run_end - 1);
+          last_match_automaton = idx;
+        }
+        forward_ptr = run_end;
+      }
     }
+  }
 
-    const std::vector<std::string> parts{trimmed.substr(0, separator_pos),
-                                         trimmed.substr(separator_pos + 1, std::string::npos)};
-    const std::string token{Trim(parts.at(0))};
-    const std::string regex_wp{Trim(parts.at(1))};
-    // Regex is surrounded by {} .. Remove the parens
-    const std::string regex{regex_wp.substr(1, regex_wp.length() - 2)};
+  assert (forward_ptr <= buflen + 1);
+  lookahead_end_ = forward_ptr;
+  if (reached_end) {
+    // Some automaton was still running at the end of the buffer
+    *reached_end = forward_ptr > buflen;
+  }
+  if (!track_lookahead_) {
+    RecordFailedRuns(mode, buffer, lexeme_ptr);
+  }
 
-    //assert (token_regex.find(token) == token_regex.end());
-    token_regex.push_back({token, regex});
+  // If there has been no match - throw error
+  if (last_match_ptr == -1) {
+    CC_TRACE("No match for lexeme @ {} - {}", lexeme_ptr, buffer_view.substr(lexeme_ptr, 30));
+    return 0;
   }
 
-  return token_regex;
+  assert (last_match_ptr >= static_cast<long>(lexeme_ptr));
+  const std::size_t length{static_cast<std::size_t>(last_match_ptr + 1) - lexeme_ptr};
+  *rule = static_cast<int>(modes_[mode].rules[last_match_automaton]);
+  CC_TRACE("lexeme @ {} - ({}, {})", lexeme_ptr, buffer_view.substr(lexeme_ptr, length),
+           spec_->GetRule(*rule).token);
+  return length;
 }
 
-std::unordered_set<std::string> Lexer::GetKeywords() {
-  std::unordered_set<std::string> keywords;
-  const std::vector<std::string> lex_def_lines{ReadFileLines(lexer_definition_file_)};
-
-  bool expect_keyword{false};
-  for (const std::string& line : lex_def_lines) {
-    const std::string trimmed{Trim(line)};
-
-    // ignore if it is a comment
-    if (IsLexDefComment(trimmed)) { continue; }
-
-    if (expect_keyword) {
-      // Make sure that the section hasn't ended
-      expect_keyword = !IsLexDefDefinitionStartLine(trimmed) && !IsLexDefSymbolStartLine(trimmed);
+void Lexer::RecordFailedRuns(const int mode, const char* const buffer,
+                             const std::size_t lexeme_ptr) {
+  const ModeAutomatons& automatons{modes_[mode]};
+  for (std::size_t idx = 0; idx < automatons.automatons.size(); ++idx) {
+    // Positions after the last accept (or from the lexeme start) up to the
+    // position the automaton died at never lead to an accepting state
+    const std::size_t failed_start{last_accept_ptrs_[idx] == -1 ?
+                                   lexeme_ptr :
+                                   static_cast<std::size_t>(last_accept_ptrs_[idx] + 1)};
+    const std::size_t scan_end{scan_end_ptrs_[idx]};
+    if (scan_end < failed_start + kMinFailedRunToMemoize) { continue; }
+
+    // Lexemes start from lexeme_ptr on - earlier runs that end before it are
+    // of no more use
+    FailedRuns& failed{failed_runs_[automatons.rules[idx]]};
+    if (lexeme_ptr >= failed.begin + failed.states.size()) {
+      failed.begin = failed_start;
+      failed.states.clear();
+      failed.more.clear();
+    }
+    if (failed_start < failed.begin) {
+      failed.states.insert(failed.states.begin(), failed.begin - failed_start, -1);
+      failed.begin = failed_start;
+    }
+    if (scan_end > failed.begin + failed.states.size()) {
+      failed.states.resize(scan_end - failed.begin, -1);
     }
 
-    if (!expect_keyword) {
-      auto kw_start_line = IsLexDefKeywordStartLine(trimmed);
-      if (kw_start_line) {
-        spdlog::debug("Keywords start encountered...");
+    // Replay the automaton to recover the states of the failed run
+    const DFA& dfa{*automatons.automatons[idx]};
+    int state{dfa.GetStartState()};
+    for (std::size_t ptr = lexeme_ptr; ptr < scan_end; ++ptr) {
+      state = dfa.GetTransition(state, buffer[ptr]);
+      assert (state >= 0);
+      if (ptr < failed_start) { continue; }
+      int& failed_state{failed.states[ptr - failed.begin]};
+      if (failed_state < 0 || failed_state == state) {
+        failed_state = state;
+      } else {
+        failed.more.insert((std::uint64_t{ptr} << 32) | static_cast<std::uint32_t>(state));
       }
-      expect_keyword = kw_start_line;
-      continue;
     }
-
-    // the entire line is a keyword
-    keywords.insert(trimmed);
   }
-
-  return keywords;
 }
 
-std::unordered_set<std::string> Lexer::GetSymbols() {
-
-  std::unordered_set<std::string> symbols;
-  const std::vector<std::string> lex_def_lines{ReadFileLines(lexer_definition_file_)};
-
-  bool expect_symbol{false};
-  for (const std::string& line : lex_def_lines) {
-    const std::string trimmed{Trim(line)};
-
-    // ignore if it is a comment
-    if (IsLexDefComment(trimmed)) { continue; }
-
-    if (expect_symbol) {
-      // Make sure that the section hasn't ended
-      expect_symbol = !IsLexDefDefinitionStartLine(trimmed) && !IsLexDefKeywordStartLine(trimmed);
-    }
-
-    if (!expect_symbol) {
-      auto symbol_start_line = IsLexDefSymbolStartLine(trimmed);
-      if (symbol_start_line) {
-        spdlog::debug("Symbol start encountered...");
-      }
-      expect_symbol = symbol_start_line;
-      continue;
-    }
+std::size_t Lexer::MatchAtJit(const char* const buffer,
+                              const std::size_t buflen,
+                              const std::size_t lexeme_ptr,
+                              int* const rule) {
+  const ModeAutomatons& mode{modes_[GetMode()]};
+  assert (mode.jit);
+  assert (lexeme_ptr < buflen);
 
-    // the entire line is a symbol
-    symbols.insert(trimmed);
+  // A scan that reads to the end of the window may go on for long
+  const std::size_t scan_end{std::min(buflen, lexeme_ptr + kMaxJitScan)};
+  int automaton_idx{-1};
+  std::size_t length{0};
+  std::size_t scan_length{0};
+  const bool matched{mode.jit->Match(buffer + lexeme_ptr, buffer + scan_end, &automaton_idx,
+                                     &length, &scan_length)};
+  if (scan_end < buflen && lexeme_ptr + scan_length >= scan_end) {
+    // The tables memoize the run if it fails
+    return MatchAtTable(buffer, buflen, lexeme_ptr, rule, nullptr);
+  }
+  if (!matched) {
+    *rule = kNoRule;
+    CC_TRACE("No match for lexeme @ {} - {}", lexeme_ptr,
+             std::string_view{buffer, buflen}.substr(lexeme_ptr, 30));
+    return 0;
   }
 
-  return symbols;
+  *rule = static_cast<int>(mode.rules[automaton_idx]);
+  CC_TRACE("lexeme @ {} - ({}, {})", lexeme_ptr, std::string_view{buffer + lexeme_ptr, length},
+           spec_->GetRule(*rule).token);
+  return length;
 }
-
-#undef COMMENT_START
-#undef DEFINITION_START
-#undef KEYWORD_START
-#undef SYMBOL_START
-#undef TOKEN_REGEX_SEP
@@ -0,0 +1,400 @@
+// Define the lexer specification
+#include "lexer/lexer_spec.hpp"
+#include "spdlog/spdlog.h"
+#include <cctype>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include "utils/file_utils.hpp"
+#include "utils/hash.hpp"
+#include "utils/source_buffer.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/trace.hpp"
+
+static const std::string kCommentStart{"//"};
+static const std::string kDefinitionStart{"DEFINITION"};
+static const std::string kKeywordStart{"KEYWORDS"};
+static const std::string kSymbolStart{"SYMBOLS"};
+static constexpr char kTokenRegexSep{':'};
+static const std::string kPushAction{"PUSH"};
+static const std::string kPopAction{"POP"};
+static constexpr std::size_t kMaxKeywordLength{64};
+
+const std::string LexerSpec::kInitialModeName{"INITIAL"};
+
+static bool StartsWith(const std::string& s, const std::string& prefix) {
+  return s.compare(0, prefix.length(), prefix) == 0;
+}
+
+// Token names in order of first appearance - a token may have rules in
+// several modes
+static std::vector<std::string> GetTokenNames(const std::vector<TokenRule>& rules) {
+  std::vector<std::string> token_names;
+  std::unordered_set<std::string> seen;
+  for (const auto& rule : rules) {
+    if (seen.insert(rule.token).second) {
+      token_names.push_back(rule.token);
+    }
+  }
+  return token_names;
+}
+
+// The bytes state loops on, if there are any and they form a ByteClass
+static std::unique_ptr<const ByteClass> FindSelfLoop(const DFA& dfa, const int state) {
+  bool members[256]{};
+  bool loops{false};
+  for (int byte = 0; byte < 256; ++byte) {
+    members[byte] = dfa.GetTransition(state, static_cast<char>(byte)) == state;
+    loops = loops || members[byte];
+  }
+
+  std::unique_ptr<ByteClass> loop{new ByteClass};
+  if (!loops || !ByteClass::FromMembers(members, loop.get())) {
+    return nullptr;
+  }
+  return loop;
+}
+
+// Add the words matched from state to spellings, folded to lower case.
+// Keywords must match a few short words.
+static void FoldedSpellings(const DFA& dfa, const int state, std::string* const prefix,
+                            std::set<std::string>* const spellings) {
+  if (prefix->length() > kMaxKeywordLength) {
+    throw std::invalid_argument(fmt::format("Keyword {}... is too long", *prefix));
+  }
+  if (dfa.IsAcceptingState(state)) {
+    spellings->insert(*prefix);
+  }
+
+  // Letters of either case lead to the same words once folded
+  std::set<std::pair<char, int>> moves;
+  for (int byte = 0; byte < 256; ++byte) {
+    const int next{dfa.GetTransition(state, static_cast<char>(byte))};
+    if (next >= 0) {
+      moves.emplace(static_cast<char>(std::tolower(byte)), next);
+    }
+  }
+  for (const auto& [c, next] : moves) {
+    prefix->push_back(c);
+    FoldedSpellings(dfa, next, prefix, spellings);
+    prefix->pop_back();
+  }
+}
+
+// Are the words keyword accepts all matched in full by one of automatons ?
+// Keyword lookup only finds a keyword in the match of another rule.
+static bool MatchesKeyword(const std::vector<const DFA*>& automatons, const DFA& keyword) {
+  // Run the keyword and the automatons in step over every keyword word; a
+  // dead automaton has state -1
+  using Step = std::pair<int, std::vector<int>>;
+  Step start{keyword.GetStartState(), {}};
+  for (const DFA* const dfa : automatons) {
+    start.second.push_back(dfa->GetStartState());
+  }
+  std::set<Step> seen{start};
+  std::vector<Step> pending{start};
+  while (!pending.empty()) {
+    const Step step{std::move(pending.back())};
+    pending.pop_back();
+
+    if (keyword.IsAcceptingState(step.first)) {
+      bool matched{false};
+      for (std::size_t i = 0; i < automatons.size() && !matched; ++i) {
+        matched = step.second[i] >= 0 && automatons[i]->IsAcceptingState(step.second[i]);
+      }
+      if (!matched) { return false; }
+    }
+
+    for (int byte = 0; byte < 256; ++byte) {
+      const char c{static_cast<char>(byte)};
+      Step next{keyword.GetTransition(step.first, c), {}};
+      if (next.first < 0) { continue; }
+      for (std::size_t i = 0; i < automatons.size(); ++i) {
+        next.second.push_back(step.second[i] < 0 ? -1 :
+                              automatons[i]->GetTransition(step.second[i], c));
+      }
+      if (seen.insert(next).second) {
+        pending.push_back(std::move(next));
+      }
+    }
+  }
+  return true;
+}
+
+// Parse [<MODE>] TOKEN : {regex} [PUSH MODE | POP]
+static bool ParseTokenRule(const std::string& line, TokenRule* const rule) {
+  std::string def{line};
+  rule->mode = LexerSpec::kInitialModeName;
+  if (def.front() == '<') {
+    const std::size_t mode_end{def.find('>')};
+    if (mode_end == std::string::npos) {
+      spdlog::error("Cannot find the end of the mode of {}", line);
+      return false;
+    }
+    rule->mode = Trim(def.substr(1, mode_end - 1));
+    def = Trim(def.substr(mode_end + 1));
+  }
+
+  const std::size_t separator_pos{def.find_first_of(kTokenRegexSep)};
+  if (separator_pos == std::string::npos) {
+    spdlog::error(fmt::format("Cannot find TOKEN_REGEX_SEPARATOR {}", line));
+    return false;
+  }
+  rule->token = Trim(def.substr(0, separator_pos));
+
+  // Regex is surrounded by {} .. Remove the parens
+  const std::string regex_wp{Trim(def.substr(separator_pos + 1))};
+  const std::size_t regex_end{regex_wp.rfind('}')};
+  if (regex_wp.empty() || regex_wp.front() != '{' ||
+      regex_end == std::string::npos || regex_end == 0) {
+    spdlog::error("Cannot find the regex of {}", line);
+    return false;
+  }
+  rule->regex = regex_wp.substr(1, regex_end - 1);
+
+  // An optional mode action follows the regex
+  std::istringstream action{regex_wp.substr(regex_end + 1)};
+  std::string verb;
+  action >> verb >> rule->push_mode;
+  if (verb.empty()) {
+    rule->action = ModeAction::NONE;
+  } else if (verb == kPushAction && !rule->push_mode.empty()) {
+    rule->action = ModeAction::PUSH;
+  } else if (verb == kPopAction && rule->push_mode.empty()) {
+    rule->action = ModeAction::POP;
+  } else {
+    spdlog::error("Cannot parse the mode action of {}", line);
+    return false;
+  }
+
+  return true;
+}
+
+LexerDefinition ReadLexerDefinition(const std::string& lexer_definition_file) {
+  enum class Section { NONE, DEFINITIONS, KEYWORDS, SYMBOLS };
+
+  LexerDefinition definition;
+  std::ifstream f{lexer_definition_file};
+  if (!f) {
+    spdlog::error("Cannot open lexer definition file {}", lexer_definition_file);
+  }
+
+  Section section{Section::NONE};
+  std::string line;
+  while (std::getline(f, line)) {
+    const std::string trimmed{Trim(line)};
+
+    // ignore comments and blank lines
+    if (trimmed.empty() || StartsWith(trimmed, kCommentStart)) { continue; }
+
+    // A section header starts a section and ends the previous one
+    if (StartsWith(trimmed, kDefinitionStart)) {
+      CC_DEBUG("Definitions start encountered...");
+      section = Section::DEFINITIONS;
+      continue;
+    }
+    if (StartsWith(trimmed, kKeywordStart)) {
+      CC_DEBUG("Keywords start encountered...");
+      section = Section::KEYWORDS;
+      continue;
+    }
+    if (StartsWith(trimmed, kSymbolStart)) {
+      CC_DEBUG("Symbol start encountered...");
+      section = Section::SYMBOLS;
+      continue;
+    }
+
+    switch (section) {
+    case Section::NONE:
+      break;
+    case Section::DEFINITIONS: {
+      TokenRule rule;
+      if (ParseTokenRule(trimmed, &rule)) {
+        definition.rules.push_back(rule);
+      }
+      break;
+    }
+    case Section::KEYWORDS:
+      // the entire line is a keyword
+      definition.keywords.insert(trimmed);
+      break;
+    case Section::SYMBOLS:
+      // the entire line is a symbol
+      definition.symbols.insert(trimmed);
+      break;
+    }
+  }
+
+  return definition;
+}
+
+std::shared_ptr<const LexerSpec> LexerSpec::Load(const std::string& lexer_definition_file) {
+  static std::mutex cache_mutex;
+  static std::unordered_map<std::string, std::shared_ptr<const LexerSpec>> cache;
+
+  const std::lock_guard<std::mutex> lock{cache_mutex};
+  auto& spec{cache[lexer_definition_file]};
+  if (!spec) {
+    spec = std::make_shared<const LexerSpec>(lexer_definition_file);
+  }
+  return spec;
+}
+
+LexerSpec::LexerSpec(const std::string& lexer_definition_file) :
+  lexer_definition_file_{lexer_definition_file},
+  fingerprint_{HashBytes(ReadFile(lexer_definition_file))},
+  definition_{ReadLexerDefinition(lexer_definition_file)},
+  token_kinds_{GetTokenNames(definition_.rules), definition_.keywords,
+               definition_.symbols} {
+  spdlog::info("Loading lexer spec {}", lexer_definition_file_);
+
+  for (const auto& rule : definition_.rules) {
+    const TokenKind kind{token_kinds_.Find(rule.token)};
+    const auto& info{token_kinds_.Get(kind)};
+    CC_DEBUG("<{}> Token {} {} Regex {}{}{}", rule.mode, kind, info.name, rule.regex,
+                  info.is_keyword ? " (keyword)" : "",
+                  info.is_symbol ? " (symbol)" : "");
+  }
+
+  ConstructModes();
+  ConstructAutomatons();
+  ConstructKeywordTables();
+}
+
+int LexerSpec::FindMode(const std::string& name) const {
+  for (std::size_t mode = 0; mode < modes_.size(); ++mode) {
+    if (modes_[mode].name == name) { return static_cast<int>(mode); }
+  }
+  return -1;
+}
+
+void LexerSpec::ConstructModes() {
+  modes_.emplace_back();
+  modes_.back().name = kInitialModeName;
+
+  rules_.resize(definition_.rules.size());
+  for (std::size_t rule = 0; rule < definition_.rules.size(); ++rule) {
+    int mode{FindMode(definition_.rules[rule].mode)};
+    if (mode < 0) {
+      mode = static_cast<int>(modes_.size());
+      modes_.emplace_back();
+      modes_.back().name = definition_.rules[rule].mode;
+    }
+    modes_[mode].rules.push_back(rule);
+    rules_[rule].kind = token_kinds_.Find(definition_.rules[rule].token);
+  }
+
+  // Modes are pushed by name - the mode must have rules
+  for (std::size_t rule = 0; rule < definition_.rules.size(); ++rule) {
+    const TokenRule& def{definition_.rules[rule]};
+    if (def.action != ModeAction::PUSH) { continue; }
+    rules_[rule].push_mode = FindMode(def.push_mode);
+    if (rules_[rule].push_mode < 0) {
+      throw std::invalid_argument(
+        fmt::format("Token {} pushes the undefined mode {}", def.token, def.push_mode));
+    }
+  }
+}
+
+void LexerSpec::ConstructAutomatons() {
+  CC_TRACE_SPAN("Lexer spec automatons");
+  const ScopedPhaseTimer timer{&automaton_time_};
+  CC_DEBUG("#Token rules {}", definition_.rules.size());
+
+  for (std::size_t rule = 0; rule < definition_.rules.size(); ++rule) {
+    const TokenRule& def{definition_.rules[rule]};
+    CC_DEBUG("{} - {}", def.token, def.regex);
+    std::unique_ptr<DFA> dfa{new DFA{def.regex}};
+    // The scanner relies on every automaton dying on the buffer sentinel
+    for (int state = 0; state < dfa->GetNumStates(); ++state) {
+      if (dfa->GetTransition(state, SourceBuffer::kSentinel) != -1) {
+        throw std::invalid_argument(
+          fmt::format("Token {} matches the end of buffer sentinel", def.token));
+      }
+    }
+    rules_[rule].state_offset = num_states_;
+    num_states_ += dfa->GetNumStates();
+    for (int state = 0; state < dfa->GetNumStates(); ++state) {
+      self_loops_.push_back(FindSelfLoop(*dfa, state));
+    }
+    rules_[rule].automaton = std::move(dfa);
+  }
+}
+
+void LexerSpec::ConstructKeywordTables() {
+  for (Mode& mode : modes_) {
+    std::vector<std::size_t> keyword_rules;
+    std::vector<const DFA*> scan_automatons;
+    for (const std::size_t rule : mode.rules) {
+      if (token_kinds_.Get(rules_[rule].kind).is_keyword) {
+        keyword_rules.push_back(rule);
+      } else {
+        mode.scan_rules.push_back(rule);
+        scan_automatons.push_back(rules_[rule].automaton.get());
+      }
+    }
+
+    // A keyword no other rule matches would never be looked up - the mode
+    // then runs the keyword automatons like the others
+    for (const std::size_t rule : keyword_rules) {
+      if (!MatchesKeyword(scan_automatons, *rules_[rule].automaton)) {
+        spdlog::warn("Keyword {} is not matched by another rule of mode {}; keyword lookup "
+                     "is off in the mode", definition_.rules[rule].token, mode.name);
+        mode.scan_rules = mode.rules;
+        keyword_rules.clear();
+        break;
+      }
+    }
+
+    std::vector<KeywordTable::Keyword> keywords;
+    for (const std::size_t rule : keyword_rules) {
+      std::set<std::string> spellings;
+      std::string prefix;
+      FoldedSpellings(*rules_[rule].automaton, rules_[rule].automaton->GetStartState(),
+                      &prefix, &spellings);
+      for (const std::string& spelling : spellings) {
+        keywords.push_back({spelling, static_cast<int>(rule)});
+      }
+    }
+    mode.keywords = KeywordTable{keywords};
+  }
+}
+
+int LexerSpec::FindKeyword(const int mode, const std::string_view text) const {
+  const int rule{modes_[mode].keywords.Find(text)};
+  if (rule < 0) { return -1; }
+
+  // The table ignores case - the automaton of the keyword decides
+  const DFA& dfa{*rules_[rule].automaton};
+  int state{dfa.GetStartState()};
+  for (const char c : text) {
+    state = dfa.GetTransition(state, c);
+    if (state < 0) { return -1; }
+  }
+  return dfa.IsAcceptingState(state) ? rule : -1;
+}
+
+const DFAJit* LexerSpec::GetJit(const int mode, const bool keyword_lookup) const {
+  const Mode& m{modes_[mode]};
+  ModeJit& mode_jit{modes_[mode].jits[keyword_lookup ? 1 : 0]};
+  std::call_once(*mode_jit.once, [this, &m, &mode_jit, keyword_lookup]() {
+    if (!DFAJit::IsSupported()) {
+      spdlog::warn("Lexer JIT unsupported on this platform; using table driven automatons");
+      return;
+    }
+
+    // Compile the automatons of the mode in precedence order
+    std::vector<const DFA*> automatons;
+    for (const std::size_t rule : keyword_lookup ? m.scan_rules : m.rules) {
+      automatons.push_back(rules_[rule].automaton.get());
+    }
+    mode_jit.jit.reset(new DFAJit{automatons});
+    if (!mode_jit.jit->IsCompiled()) {
+      spdlog::warn("Lexer JIT compilation failed; using table driven automatons");
+      mode_jit.jit.reset();
+    }
+  });
+  return mode_jit.jit.get();
+}
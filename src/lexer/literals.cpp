@@ -0,0 +1,97 @@
+// Define the literal scanner
+#include "lexer/literals.hpp"
+#include <cassert>
+#include <limits>
+
+const char* GetLiteralErrorMessage(const LiteralError error) {
+  switch (error) {
+  case LiteralError::NONE:
+    break;
+  case LiteralError::INTEGER_TOO_LARGE:
+    return "Integer constant too large";
+  case LiteralError::STRING_TOO_LONG:
+    return "String constant too long";
+  case LiteralError::STRING_NULL:
+    return "String contains null character.";
+  case LiteralError::STRING_ESCAPED_NULL:
+    return "String contains escaped null character.";
+  case LiteralError::STRING_UNTERMINATED:
+    return "Unterminated string constant";
+  case LiteralError::STRING_EOF:
+    return "EOF in string constant";
+  }
+  return "";
+}
+
+static char DecodeEscape(const char c) {
+  switch (c) {
+  case 'b': return '\b';
+  case 't': return '\t';
+  case 'n': return '\n';
+  case 'f': return '\f';
+  default: return c;
+  }
+}
+
+StringLiteral ScanStringLiteral(const std::string_view input, std::string* const decoded) {
+  assert (!input.empty() && input.front() == '"');
+  if (decoded) { decoded->clear(); }
+
+  StringLiteral literal;
+  const auto fail{[&literal](const LiteralError error) {
+    // A string that broke a rule is still scanned to its end
+    if (literal.error == LiteralError::NONE) { literal.error = error; }
+  }};
+
+  std::size_t num_chars{0};
+  std::size_t ptr{1};
+  while (true) {
+    if (ptr == input.length()) {
+      fail(LiteralError::STRING_EOF);
+      literal.reached_end = true;
+      break;
+    }
+
+    char c{input[ptr++]};
+    if (c == '"') { break; }
+    if (c == '\n') {
+      fail(LiteralError::STRING_UNTERMINATED);
+      break;
+    }
+    if (c == '\0') {
+      fail(LiteralError::STRING_NULL);
+      continue;
+    }
+    if (c == '\\') {
+      if (ptr == input.length()) { continue; }
+      c = input[ptr++];
+      if (c == '\0') {
+        fail(LiteralError::STRING_ESCAPED_NULL);
+        continue;
+      }
+      c = DecodeEscape(c);
+    }
+
+    if (++num_chars > kMaxStringLength) {
+      fail(LiteralError::STRING_TOO_LONG);
+    } else if (decoded) {
+      decoded->push_back(c);
+    }
+  }
+
+  literal.length = ptr;
+  return literal;
+}
+
+bool DecodeInteger(const std::string_view digits, std::int32_t* const value) {
+  assert (value);
+  constexpr std::int64_t kMax{std::numeric_limits<std::int32_t>::max()};
+  std::int64_t n{0};
+  for (const char c : digits) {
+    assert (c >= '0' && c <= '9');
+    n = 10 * n + (c - '0');
+    if (n > kMax) { return false; }
+  }
+  *value = static_cast<std::int32_t>(n);
+  return true;
+}
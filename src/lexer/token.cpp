@@ -0,0 +1,55 @@
+// Define the token buffer
+#include "lexer/token.hpp"
+#include <algorithm>
+#include <cassert>
+
+void TokenBuffer::Reserve(const std::size_t num_tokens) {
+  kinds_.reserve(num_tokens);
+  offsets_.reserve(num_tokens);
+  lengths_.reserve(num_tokens);
+  symbols_.reserve(num_tokens);
+}
+
+void TokenBuffer::Clear() {
+  // Keeps the capacity - a buffer reused across files does not reallocate
+  kinds_.clear();
+  offsets_.clear();
+  lengths_.clear();
+  symbols_.clear();
+}
+
+void TokenBuffer::Append(const TokenBuffer& other) {
+  kinds_.insert(kinds_.end(), other.kinds_.begin(), other.kinds_.end());
+  offsets_.insert(offsets_.end(), other.offsets_.begin(), other.offsets_.end());
+  lengths_.insert(lengths_.end(), other.lengths_.begin(), other.lengths_.end());
+  symbols_.insert(symbols_.end(), other.symbols_.begin(), other.symbols_.end());
+}
+
+void TokenBuffer::Assign(const TokenKind* const kinds, const std::uint32_t* const offsets,
+                         const std::uint32_t* const lengths, const std::size_t num_tokens,
+                         const SymbolId* const symbols) {
+  kinds_.assign(kinds, kinds + num_tokens);
+  offsets_.assign(offsets, offsets + num_tokens);
+  lengths_.assign(lengths, lengths + num_tokens);
+  if (symbols) {
+    symbols_.assign(symbols, symbols + num_tokens);
+  } else {
+    symbols_.assign(num_tokens, kNoSymbol);
+  }
+}
+
+void TokenBuffer::Replace(const std::size_t first, const std::size_t num_removed,
+                          const TokenBuffer& replacement) {
+  ReplaceRange(&kinds_, first, num_removed, replacement.kinds_);
+  ReplaceRange(&offsets_, first, num_removed, replacement.offsets_);
+  ReplaceRange(&lengths_, first, num_removed, replacement.lengths_);
+  ReplaceRange(&symbols_, first, num_removed, replacement.symbols_);
+}
+
+void TokenBuffer::ShiftOffsets(const std::size_t first, const std::size_t last,
+                               const std::int64_t delta) {
+  assert (first <= last && last <= offsets_.size());
+  for (std::size_t i = first; i < last; ++i) {
+    offsets_[i] = static_cast<std::uint32_t>(offsets_[i] + delta);
+  }
+}
@@ -0,0 +1,189 @@
+// Define the on-disk token cache
+#include "lexer/token_cache.hpp"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include <vector>
+#include <unistd.h>
+#include <fmt/format.h>
+#include "utils/buffered_writer.hpp"
+#include "utils/hash.hpp"
+#include "utils/source_buffer.hpp"
+
+namespace fs = std::filesystem;
+
+static const std::string kEntryExtension{".cctc"};
+
+// Seeds the check hash apart from the entry hash
+static constexpr std::uint64_t kCheckSeed{0x9e3779b97f4a7c15};
+
+static_assert(sizeof(TokenCacheHeader) == 40, "Token cache header must not be padded");
+
+// The kinds column is padded so that the uint32 columns are aligned
+static std::size_t KindsBytes(const std::size_t num_tokens) {
+  return (num_tokens * sizeof(TokenKind) + 3) & ~std::size_t{3};
+}
+
+static std::size_t EntryBytes(const std::size_t num_tokens) {
+  return sizeof(TokenCacheHeader) + KindsBytes(num_tokens) +
+    3 * num_tokens * sizeof(std::uint32_t);
+}
+
+TokenCache::TokenCache(const std::string& directory, const std::uint64_t max_bytes) :
+  directory_{directory},
+  max_bytes_{max_bytes} {
+  std::error_code error;
+  fs::create_directories(directory_, error);
+  if (error) {
+    spdlog::warn("Cannot create token cache {}: {}", directory_, error.message());
+  }
+  Evict();
+}
+
+TokenCacheKey TokenCache::Key(const LexerSpec& spec, const std::string_view contents) {
+  const std::uint64_t version{(std::uint64_t{LexerSpec::kScannerVersion} << 32) | kVersion};
+  const std::uint64_t seed{spec.GetFingerprint() ^ version};
+  return {HashBytes(contents, seed), HashBytes(contents, seed ^ kCheckSeed), contents.size()};
+}
+
+std::string TokenCache::EntryPath(const std::uint64_t hash) const {
+  return fmt::format("{}/{:016x}{}", directory_, hash, kEntryExtension);
+}
+
+bool TokenCache::Load(const TokenCacheKey& key, TokenBuffer* const tokens) {
+  const std::string path{EntryPath(key.hash)};
+  std::error_code error;
+  if (!fs::is_regular_file(path, error)) {
+    ++misses_;
+    return false;
+  }
+
+  // The entry is mapped; its columns are copied straight into tokens, which
+  // own their columns - the lexer interns symbols into them
+  std::shared_ptr<const SourceBuffer> entry;
+  try {
+    entry = SourceBuffer::FromFile(path);
+  } catch (const std::runtime_error& e) {
+    spdlog::warn("Skipping token cache entry - {}", e.what());
+    ++misses_;
+    return false;
+  }
+  TokenCacheHeader header;
+  if (entry->size() >= sizeof(header)) {
+    std::memcpy(&header, entry->data(), sizeof(header));
+  }
+  if (entry->size() < sizeof(header) ||
+      std::memcmp(header.magic, kMagic, sizeof(kMagic)) ||
+      header.version != kVersion || header.hash != key.hash ||
+      entry->size() != EntryBytes(header.num_tokens)) {
+    spdlog::warn("Removing corrupt token cache entry {}", path);
+    fs::remove(path, error);
+    ++misses_;
+    return false;
+  }
+  // Other contents with the same hash; storing their tokens replaces it
+  if (header.check != key.check || header.source_bytes != key.source_bytes) {
+    ++misses_;
+    return false;
+  }
+
+  const char* const kinds{entry->data() + sizeof(header)};
+  const char* const offsets{kinds + KindsBytes(header.num_tokens)};
+  const char* const lengths{offsets + header.num_tokens * sizeof(std::uint32_t)};
+  const char* const errors{lengths + header.num_tokens * sizeof(std::uint32_t)};
+  tokens->Assign(reinterpret_cast<const TokenKind*>(kinds),
+                 reinterpret_cast<const std::uint32_t*>(offsets),
+                 reinterpret_cast<const std::uint32_t*>(lengths), header.num_tokens,
+                 reinterpret_cast<const SymbolId*>(errors));
+
+  // Mark the entry as recently used
+  fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+  ++hits_;
+  return true;
+}
+
+void TokenCache::Store(const TokenCacheKey& key, const TokenBuffer& tokens) {
+  TokenCacheHeader header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.num_tokens = static_cast<std::uint32_t>(tokens.Size());
+  header.hash = key.hash;
+  header.check = key.check;
+  header.source_bytes = key.source_bytes;
+
+  static std::atomic<std::uint64_t> num_temporaries{0};
+  const std::string path{EntryPath(key.hash)};
+  const std::string temporary{fmt::format("{}.{}.{}.tmp", path, getpid(), num_temporaries++)};
+  {
+    BufferedWriter out{temporary};
+    if (!out.IsOpen()) { return; }
+    const std::size_t kinds_bytes{tokens.Size() * sizeof(TokenKind)};
+    out.Write(std::string_view{reinterpret_cast<const char*>(&header), sizeof(header)});
+    out.Write(std::string_view{reinterpret_cast<const char*>(tokens.Kinds().data()), kinds_bytes});
+    out.Write(std::string_view{"\0\0\0", KindsBytes(tokens.Size()) - kinds_bytes});
+    out.Write(std::string_view{reinterpret_cast<const char*>(tokens.Offsets().data()),
+                               tokens.Size() * sizeof(std::uint32_t)});
+    out.Write(std::string_view{reinterpret_cast<const char*>(tokens.Lengths().data()),
+                               tokens.Size() * sizeof(std::uint32_t)});
+    std::vector<SymbolId> errors(tokens.Size(), kNoSymbol);
+    for (std::size_t i = 0; i < tokens.Size(); ++i) {
+      if (tokens.Kind(i) == kInvalidTokenKind) { errors[i] = tokens.Symbol(i); }
+    }
+    out.Write(std::string_view{reinterpret_cast<const char*>(errors.data()),
+                               errors.size() * sizeof(SymbolId)});
+  }
+
+  std::error_code error;
+  fs::rename(temporary, path, error);
+  if (error) {
+    spdlog::warn("Cannot store token cache entry {}: {}", path, error.message());
+    fs::remove(temporary, error);
+    return;
+  }
+  ++stores_;
+
+  if ((num_bytes_ += EntryBytes(tokens.Size())) > max_bytes_) {
+    Evict();
+  }
+}
+
+void TokenCache::Evict() {
+  struct Entry {
+    fs::file_time_type last_used;
+    std::uint64_t size;
+    fs::path path;
+  };
+
+  const std::lock_guard<std::mutex> lock{evict_mutex_};
+  std::vector<Entry> entries;
+  std::uint64_t num_bytes{0};
+  std::error_code error;
+  for (const auto& file : fs::directory_iterator{directory_, error}) {
+    if (file.path().extension() != kEntryExtension) { continue; }
+    std::error_code entry_error;
+    Entry entry{file.last_write_time(entry_error), file.file_size(entry_error), file.path()};
+    if (entry_error) { continue; }
+    num_bytes += entry.size;
+    entries.push_back(std::move(entry));
+  }
+
+  if (num_bytes > max_bytes_) {
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+      return a.last_used < b.last_used;
+    });
+    for (const Entry& entry : entries) {
+      if (num_bytes <= max_bytes_) { break; }
+      if (fs::remove(entry.path, error)) {
+        num_bytes -= entry.size;
+        ++evictions_;
+      }
+    }
+  }
+  num_bytes_ = num_bytes;
+}
+
+TokenCacheStats TokenCache::GetStats() const {
+  return {hits_.load(), misses_.load(), stores_.load(), evictions_.load()};
+}
@@ -0,0 +1,227 @@
+// Define the token file writer and reader
+#include "lexer/token_file.hpp"
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <fmt/format.h>
+#include "utils/buffered_writer.hpp"
+
+namespace {
+
+static_assert(sizeof(TokenFileHeader) == 48, "Token file header must not be padded");
+
+void AppendVarint(std::string* const out, std::uint32_t value) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+void AppendU16(std::string* const out, const std::uint16_t value) {
+  out->push_back(static_cast<char>(value & 0xff));
+  out->push_back(static_cast<char>(value >> 8));
+}
+
+std::uint32_t LoadU32(const char* const data) {
+  const auto* const bytes{reinterpret_cast<const unsigned char*>(data)};
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+    (static_cast<std::uint32_t>(bytes[3]) << 24);
+}
+
+void StoreU32(char* const data, const std::uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    data[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+  }
+}
+
+} // namespace
+
+TokenFileWriter::TokenFileWriter(const TokenKindTable& token_kinds) :
+  token_kinds_{token_kinds} {
+}
+
+void TokenFileWriter::Append(const TokenKind kind, const std::uint32_t offset,
+                             const std::uint32_t line_no, const std::string_view text) {
+  assert (kind >= 0 && static_cast<std::size_t>(kind) < token_kinds_.Size());
+  assert (offset >= last_offset_ && line_no >= last_line_no_);
+
+  AppendU16(&kinds_, static_cast<std::uint16_t>(kind));
+  AppendVarint(&offsets_, offset - last_offset_);
+  AppendVarint(&lines_, line_no - last_line_no_);
+  last_offset_ = offset;
+  last_line_no_ = line_no;
+
+  if (token_kinds_.HasLexeme(kind)) {
+    const auto [it, inserted]{string_ids_.emplace(text, strings_.size())};
+    if (inserted) {
+      strings_.push_back(text);
+    }
+    AppendVarint(&lexemes_, it->second);
+  }
+
+  ++num_tokens_;
+}
+
+void TokenFileWriter::Write(const std::string& file_name) const {
+  std::string kind_names;
+  for (std::size_t kind = 0; kind < token_kinds_.Size(); ++kind) {
+    const std::string& name{token_kinds_.Get(kind).name};
+    kind_names.push_back(token_kinds_.HasLexeme(kind) ? 1 : 0);
+    AppendVarint(&kind_names, name.length());
+    kind_names.append(name);
+  }
+
+  std::string strings;
+  for (const std::string_view s : strings_) {
+    AppendVarint(&strings, s.length());
+    strings.append(s);
+  }
+
+  // Sections follow the header in file order
+  char header[sizeof(TokenFileHeader)];
+  std::memcpy(header, kMagic, sizeof(kMagic));
+  const std::uint32_t kind_names_offset{sizeof(TokenFileHeader)};
+  const std::uint32_t kinds_offset{kind_names_offset + static_cast<std::uint32_t>(kind_names.size())};
+  const std::uint32_t offsets_offset{kinds_offset + static_cast<std::uint32_t>(kinds_.size())};
+  const std::uint32_t lines_offset{offsets_offset + static_cast<std::uint32_t>(offsets_.size())};
+  const std::uint32_t lexemes_offset{lines_offset + static_cast<std::uint32_t>(lines_.size())};
+  const std::uint32_t strings_offset{lexemes_offset + static_cast<std::uint32_t>(lexemes_.size())};
+  const std::uint32_t file_size{strings_offset + static_cast<std::uint32_t>(strings.size())};
+  const std::uint32_t fields[]{kVersion, static_cast<std::uint32_t>(token_kinds_.Size()),
+                               num_tokens_, static_cast<std::uint32_t>(strings_.size()),
+                               kind_names_offset, kinds_offset, offsets_offset, lines_offset,
+                               lexemes_offset, strings_offset, file_size};
+  for (std::size_t i = 0; i < std::size(fields); ++i) {
+    StoreU32(header + sizeof(kMagic) + 4 * i, fields[i]);
+  }
+
+  BufferedWriter out{file_name};
+  out.Write(std::string_view{header, sizeof(header)});
+  out.Write(kind_names);
+  out.Write(kinds_);
+  out.Write(offsets_);
+  out.Write(lines_);
+  out.Write(lexemes_);
+  out.Write(strings);
+}
+
+TokenFileReader::TokenFileReader(const std::string& file_name) :
+  file_{SourceBuffer::FromFile(file_name)} {
+
+  const char* const data{file_->data()};
+  const std::size_t size{file_->size()};
+  if (size < sizeof(TokenFileHeader) ||
+      std::memcmp(data, TokenFileWriter::kMagic, sizeof(TokenFileWriter::kMagic))) {
+    throw std::runtime_error(fmt::format("{} is not a token file", file_name));
+  }
+
+  std::uint32_t* const fields[]{&header_.version, &header_.num_kinds, &header_.num_tokens,
+                                &header_.num_strings, &header_.kind_names_offset,
+                                &header_.kinds_offset, &header_.offsets_offset,
+                                &header_.lines_offset, &header_.lexemes_offset,
+                                &header_.strings_offset, &header_.file_size};
+  std::memcpy(header_.magic, data, sizeof(header_.magic));
+  for (std::size_t i = 0; i < std::size(fields); ++i) {
+    *fields[i] = LoadU32(data + sizeof(header_.magic) + 4 * i);
+  }
+
+  if (header_.version != TokenFileWriter::kVersion) {
+    throw std::runtime_error(fmt::format("{} has unsupported token file version {}",
+                                         file_name, header_.version));
+  }
+  if (header_.file_size != size ||
+      header_.kind_names_offset < sizeof(TokenFileHeader) ||
+      header_.kinds_offset < header_.kind_names_offset ||
+      header_.offsets_offset < header_.kinds_offset ||
+      header_.offsets_offset - header_.kinds_offset != 2ull * header_.num_tokens ||
+      header_.lines_offset < header_.offsets_offset ||
+      header_.lexemes_offset < header_.lines_offset ||
+      header_.strings_offset < header_.lexemes_offset ||
+      header_.file_size < header_.strings_offset) {
+    throw std::runtime_error(fmt::format("{} is a truncated or corrupt token file", file_name));
+  }
+
+  // Kind names and strings are views into the mapped file
+  std::size_t ptr{header_.kind_names_offset};
+  for (std::uint32_t i = 0; i < header_.num_kinds; ++i) {
+    if (ptr >= header_.kinds_offset) {
+      throw std::runtime_error(fmt::format("{} has a corrupt kind table", file_name));
+    }
+    kind_has_lexeme_.push_back(data[ptr++] != 0);
+    const std::uint32_t length{ReadVarint(&ptr, header_.kinds_offset)};
+    if (length > header_.kinds_offset - ptr) {
+      throw std::runtime_error(fmt::format("{} has a corrupt kind table", file_name));
+    }
+    kind_names_.emplace_back(data + ptr, length);
+    ptr += length;
+  }
+
+  ptr = header_.strings_offset;
+  for (std::uint32_t i = 0; i < header_.num_strings; ++i) {
+    const std::uint32_t length{ReadVarint(&ptr, header_.file_size)};
+    if (length > header_.file_size - ptr) {
+      throw std::runtime_error(fmt::format("{} has a corrupt string table", file_name));
+    }
+    strings_.emplace_back(data + ptr, length);
+    ptr += length;
+  }
+
+  Rewind();
+}
+
+void TokenFileReader::Rewind() {
+  next_token_ = 0;
+  offsets_ptr_ = header_.offsets_offset;
+  lines_ptr_ = header_.lines_offset;
+  lexemes_ptr_ = header_.lexemes_offset;
+  last_record_ = TokenRecord{};
+}
+
+bool TokenFileReader::Next(TokenRecord* const record) {
+  assert (record);
+
+  if (next_token_ == header_.num_tokens) {
+    return false;
+  }
+
+  const char* const kind_bytes{file_->data() + header_.kinds_offset + 2 * next_token_};
+  const TokenKind kind{static_cast<TokenKind>(static_cast<unsigned char>(kind_bytes[0]) |
+                                              (static_cast<unsigned char>(kind_bytes[1]) << 8))};
+  if (kind < 0 || static_cast<std::size_t>(kind) >= kind_names_.size()) {
+    throw std::runtime_error(fmt::format("Token {} has an unknown kind {}", next_token_, kind));
+  }
+
+  last_record_.kind = kind;
+  last_record_.offset += ReadVarint(&offsets_ptr_, header_.lines_offset);
+  last_record_.line_no += ReadVarint(&lines_ptr_, header_.lexemes_offset);
+  last_record_.lexeme = {};
+  if (kind_has_lexeme_[kind]) {
+    const std::uint32_t string_id{ReadVarint(&lexemes_ptr_, header_.strings_offset)};
+    if (string_id >= strings_.size()) {
+      throw std::runtime_error(fmt::format("Token {} has an unknown lexeme {}",
+                                           next_token_, string_id));
+    }
+    last_record_.lexeme = strings_[string_id];
+  }
+
+  *record = last_record_;
+  ++next_token_;
+  return true;
+}
+
+std::uint32_t TokenFileReader::ReadVarint(std::size_t* const ptr, const std::size_t end) const {
+  const char* const data{file_->data()};
+  std::uint32_t value{0};
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (*ptr >= end) {
+      break;
+    }
+    const unsigned char byte{static_cast<unsigned char>(data[(*ptr)++])};
+    value |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return value;
+    }
+  }
+  throw std::runtime_error(fmt::format("Malformed varint in {}", file_->GetFileName()));
+}
@@ -0,0 +1,32 @@
+// Define the token kind table
+#include "lexer/token_kinds.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <iterator>
+#include <limits>
+
+TokenKindTable::TokenKindTable(const std::vector<std::string>& token_names,
+                               const std::unordered_set<std::string>& keywords,
+                               const std::unordered_set<std::string>& symbols) {
+  assert (token_names.size() <
+          static_cast<std::size_t>(std::numeric_limits<TokenKind>::max()));
+
+  for (const auto& name : token_names) {
+    TokenKindInfo info;
+    info.name = name;
+    std::transform(name.begin(), name.end(),
+                   std::back_inserter(info.lower_name),
+                   [](const char x) { return std::tolower(x); });
+    info.is_keyword = keywords.find(name) != keywords.end();
+    info.is_symbol = symbols.find(name) != symbols.end();
+
+    kind_by_name_.insert({name, static_cast<TokenKind>(kinds_.size())});
+    kinds_.push_back(info);
+  }
+}
+
+TokenKind TokenKindTable::Find(const std::string& name) const {
+  const auto kind{kind_by_name_.find(name)};
+  return kind == kind_by_name_.end() ? kInvalidTokenKind : kind->second;
+}
@@ -0,0 +1,73 @@
+// Implementation of the buffered output sink
+
+#include "utils/buffered_writer.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+BufferedWriter::BufferedWriter(const std::string& file_name) :
+  file_name_{file_name},
+  fd_{open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)},
+  owns_fd_{true},
+  buffer_{new char[kBufferSize]} {
+  if (fd_ < 0) {
+    spdlog::error("Cannot open {} - {}", file_name_, std::strerror(errno));
+  }
+}
+
+BufferedWriter::BufferedWriter(const int fd) :
+  file_name_{fmt::format("fd {}", fd)},
+  fd_{fd},
+  buffer_{new char[kBufferSize]} {
+}
+
+BufferedWriter::~BufferedWriter() {
+  Flush();
+  if (owns_fd_ && fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+void BufferedWriter::Write(const std::string_view text) {
+  if (used_ + text.length() > kBufferSize) {
+    Flush();
+    // Too large to buffer - write it through
+    if (text.length() > kBufferSize) {
+      WriteAll(text.data(), text.length());
+      return;
+    }
+  }
+  std::memcpy(buffer_.get() + used_, text.data(), text.length());
+  used_ += text.length();
+}
+
+void BufferedWriter::WriteNumber(const std::uint64_t n) {
+  const fmt::format_int digits{n};
+  Write(std::string_view{digits.data(), digits.size()});
+}
+
+void BufferedWriter::Flush() {
+  WriteAll(buffer_.get(), used_);
+  used_ = 0;
+}
+
+void BufferedWriter::WriteAll(const char* data, std::size_t length) {
+  if (fd_ < 0) { return; }
+
+  while (length) {
+    const ssize_t n{write(fd_, data, length)};
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n < 0) {
+      // Report once and drop the rest of the output
+      spdlog::error("Cannot write {} - {}", file_name_, std::strerror(errno));
+      if (owns_fd_) { close(fd_); }
+      fd_ = -1;
+      return;
+    }
+    data += n;
+    length -= n;
+  }
+}
@@ -0,0 +1,196 @@
+// Implementation of the byte scanning kernels
+
+#include "utils/byte_scan.hpp"
+#include <cassert>
+#include <limits>
+#include <utility>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+// AVX2 kernels are chosen at run time, so they are built whatever the target
+#if defined(__GNUC__) && defined(__x86_64__)
+#define BYTE_SCAN_AVX2
+#include <immintrin.h>
+#endif
+
+void FindAllBytes(const std::string_view buffer, const char byte,
+                  std::vector<std::uint32_t>* const offsets) {
+  assert (offsets);
+  assert (buffer.length() <= std::numeric_limits<std::uint32_t>::max());
+
+  const char* const data{buffer.data()};
+  const std::size_t length{buffer.length()};
+  std::size_t i{0};
+
+#if defined(__SSE2__)
+  // Compare 16 bytes at a time; the set bits of the mask are the matches
+  const __m128i needle{_mm_set1_epi8(byte)};
+  for (; i + 16 <= length; i += 16) {
+    const __m128i chunk{_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i))};
+    unsigned mask{static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)))};
+    while (mask) {
+      offsets->push_back(static_cast<std::uint32_t>(i + __builtin_ctz(mask)));
+      mask &= mask - 1;
+    }
+  }
+#endif
+
+  for (; i < length; ++i) {
+    if (data[i] == byte) {
+      offsets->push_back(static_cast<std::uint32_t>(i));
+    }
+  }
+}
+
+bool ByteClass::FromMembers(const bool (&members)[256], ByteClass* const byte_class) {
+  assert (byte_class);
+
+  // Maximal runs of members as [lo, hi]
+  std::vector<std::pair<int, int>> runs;
+  for (int byte = 0; byte < 256; ++byte) {
+    if (!members[byte]) { continue; }
+    if (!runs.empty() && runs.back().second == byte - 1) {
+      runs.back().second = byte;
+    } else {
+      runs.emplace_back(byte, byte);
+    }
+  }
+
+  // Merge the runs closest together until few enough are left; the bytes
+  // between merged runs become holes
+  std::size_t num_holes{0};
+  while (runs.size() > kMaxRanges) {
+    std::size_t closest{0};
+    for (std::size_t i = 1; i + 1 < runs.size(); ++i) {
+      if (runs[i + 1].first - runs[i].second < runs[closest + 1].first - runs[closest].second) {
+        closest = i;
+      }
+    }
+    num_holes += runs[closest + 1].first - runs[closest].second - 1;
+    if (num_holes > kMaxHoles) { return false; }
+    runs[closest].second = runs[closest + 1].second;
+    runs.erase(runs.begin() + closest + 1);
+  }
+
+  *byte_class = ByteClass{};
+  for (const auto& [lo, hi] : runs) {
+    byte_class->ranges[byte_class->num_ranges++] =
+      Range{static_cast<unsigned char>(lo), static_cast<unsigned char>(hi - lo)};
+    for (int byte = lo; byte <= hi; ++byte) {
+      if (!members[byte]) {
+        byte_class->holes[byte_class->num_holes++] = static_cast<unsigned char>(byte);
+      }
+    }
+  }
+  return true;
+}
+
+bool ByteClass::Contains(const unsigned char byte) const {
+  for (std::size_t i = 0; i < num_holes; ++i) {
+    if (byte == holes[i]) { return false; }
+  }
+  for (std::size_t i = 0; i < num_ranges; ++i) {
+    if (static_cast<unsigned char>(byte - ranges[i].lo) <= ranges[i].width) { return true; }
+  }
+  return false;
+}
+
+// The vector kernels test a chunk of bytes against every range and hole at
+// once. A byte is in a range iff (byte - lo) <= width as unsigned bytes,
+// i.e. iff max(byte - lo, width) == width. Each kernel stops at the first
+// chunk holding a byte outside the class and returns true with *pos at that
+// byte, or returns false with *pos where less than a chunk is left.
+
+#if defined(__SSE2__)
+static bool SkipByteClassSse2(const char* const data, const std::size_t length,
+                              std::size_t* const pos, const ByteClass& byte_class) {
+  __m128i los[ByteClass::kMaxRanges];
+  __m128i widths[ByteClass::kMaxRanges];
+  __m128i holes[ByteClass::kMaxHoles];
+  for (std::size_t i = 0; i < byte_class.num_ranges; ++i) {
+    los[i] = _mm_set1_epi8(static_cast<char>(byte_class.ranges[i].lo));
+    widths[i] = _mm_set1_epi8(static_cast<char>(byte_class.ranges[i].width));
+  }
+  for (std::size_t i = 0; i < byte_class.num_holes; ++i) {
+    holes[i] = _mm_set1_epi8(static_cast<char>(byte_class.holes[i]));
+  }
+
+  for (; *pos + 16 <= length; *pos += 16) {
+    const __m128i chunk{_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + *pos))};
+    __m128i in{_mm_setzero_si128()};
+    for (std::size_t i = 0; i < byte_class.num_ranges; ++i) {
+      const __m128i offset{_mm_sub_epi8(chunk, los[i])};
+      in = _mm_or_si128(in, _mm_cmpeq_epi8(_mm_max_epu8(offset, widths[i]), widths[i]));
+    }
+    for (std::size_t i = 0; i < byte_class.num_holes; ++i) {
+      in = _mm_andnot_si128(_mm_cmpeq_epi8(chunk, holes[i]), in);
+    }
+    const unsigned out{~static_cast<unsigned>(_mm_movemask_epi8(in)) & 0xffffu};
+    if (out) {
+      *pos += __builtin_ctz(out);
+      return true;
+    }
+  }
+  return false;
+}
+#endif
+
+#if defined(BYTE_SCAN_AVX2)
+// Only called when the CPU has AVX2
+__attribute__((target("avx2")))
+static bool SkipByteClassAvx2(const char* const data, const std::size_t length,
+                              std::size_t* const pos, const ByteClass& byte_class) {
+  __m256i los[ByteClass::kMaxRanges];
+  __m256i widths[ByteClass::kMaxRanges];
+  __m256i holes[ByteClass::kMaxHoles];
+  for (std::size_t i = 0; i < byte_class.num_ranges; ++i) {
+    los[i] = _mm256_set1_epi8(static_cast<char>(byte_class.ranges[i].lo));
+    widths[i] = _mm256_set1_epi8(static_cast<char>(byte_class.ranges[i].width));
+  }
+  for (std::size_t i = 0; i < byte_class.num_holes; ++i) {
+    holes[i] = _mm256_set1_epi8(static_cast<char>(byte_class.holes[i]));
+  }
+
+  for (; *pos + 32 <= length; *pos += 32) {
+    const __m256i chunk{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + *pos))};
+    __m256i in{_mm256_setzero_si256()};
+    for (std::size_t i = 0; i < byte_class.num_ranges; ++i) {
+      const __m256i offset{_mm256_sub_epi8(chunk, los[i])};
+      in = _mm256_or_si256(in, _mm256_cmpeq_epi8(_mm256_max_epu8(offset, widths[i]), widths[i]));
+    }
+    for (std::size_t i = 0; i < byte_class.num_holes; ++i) {
+      in = _mm256_andnot_si256(_mm256_cmpeq_epi8(chunk, holes[i]), in);
+    }
+    const unsigned out{~static_cast<unsigned>(_mm256_movemask_epi8(in))};
+    if (out) {
+      *pos += __builtin_ctz(out);
+      return true;
+    }
+  }
+  return false;
+}
+#endif
+
+std::size_t SkipByteClass(const std::string_view buffer, std::size_t pos,
+                          const ByteClass& byte_class) {
+  const char* const data{buffer.data()};
+  const std::size_t length{buffer.length()};
+  assert (pos <= length);
+
+#if defined(BYTE_SCAN_AVX2)
+  static const bool has_avx2{__builtin_cpu_supports("avx2") != 0};
+  if (has_avx2 && SkipByteClassAvx2(data, length, &pos, byte_class)) {
+    return pos;
+  }
+#endif
+#if defined(__SSE2__)
+  if (SkipByteClassSse2(data, length, &pos, byte_class)) {
+    return pos;
+  }
+#endif
+
+  while (pos < length && byte_class.Contains(static_cast<unsigned char>(data[pos]))) {
+    ++pos;
+  }
+  return pos;
+}
@@ -1,36 +1,48 @@
 #include <utils/file_location.hpp>
-#include <utils/file_utils.hpp>
+#include <utils/byte_scan.hpp>
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+#include <fmt/format.h>
 #include <spdlog/spdlog.h>
 
-FileLocation::FileLocation(const std::string& filename)
-  : file_name_{filename},
-    file_lines_{ReadFileLines(filename)}{
+FileLocation::FileLocation(const std::shared_ptr<const SourceBuffer>& source)
+  : source_{source} {
+  assert (source_);
+}
 
-  int buf_idx{0};
-  for (const auto& file_line : file_lines_) {
-   line_start_indices_.emplace_back(buf_idx);
-   buf_idx += file_line.length() + 1;
+void FileLocation::BuildIndex() {
+  if (source_->size() > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::length_error(fmt::format("{} is too large to index", source_->GetFileName()));
   }
 
-#if 0
-  for (int i = 0; i < static_cast<int>(file_lines_.size()); ++i) {
-    spdlog::info("{} {} {}", line_start_indices_.at(i),
-		 file_lines_.at(i), file_lines_.at(i).length());
-  }
-#endif
+  FindAllBytes(source_->View(), '\n', &newline_offsets_);
+  indexed_ = true;
+}
+
+const std::vector<std::uint32_t>& FileLocation::GetNewlineOffsets() {
+  if (!indexed_) { BuildIndex(); }
+  return newline_offsets_;
+}
+
+std::size_t FileLocation::GetLineNo(const std::size_t buf_idx) {
+  // Line number is the number of newlines before buf_idx
+  const auto& newlines{GetNewlineOffsets()};
+  return std::lower_bound(newlines.begin(), newlines.end(), buf_idx) - newlines.begin();
 }
 
 FileLocationInfo FileLocation::GetFileLocationInfo(const std::size_t buf_idx) {
 
-  // line number
-  const auto line_start_ub{std::upper_bound(line_start_indices_.begin(),
-					    line_start_indices_.end(),
-					    buf_idx)};
-  const int line_no = buf_idx == 0 ? 0 :  line_start_ub - line_start_indices_.begin() - 1;
-  const int col_no = buf_idx - line_start_indices_.at(line_no);
-  //spdlog::info("linestart found {} - {} {} {}", *line_start_ub, buf_idx, line_no, col_no);
-  assert (col_no >= 0 && col_no <= static_cast<int>(file_lines_.at(line_no).length()));
-  const std::string line = file_lines_.at(line_no);
-  return {file_name_, buf_idx, static_cast<std::size_t>(line_no),
-	  static_cast<std::size_t>(col_no), file_lines_.at(line_no)};
+  const std::size_t line_no{GetLineNo(buf_idx)};
+  const std::size_t line_start{line_no == 0 ? 0 : newline_offsets_[line_no - 1] + 1};
+  const std::size_t col_no{buf_idx - line_start};
+
+  // The line without its newline
+  const std::string_view buffer{source_->View()};
+  const std::size_t line_end{line_no < newline_offsets_.size() ?
+                             newline_offsets_[line_no] : buffer.length()};
+  assert (line_start + col_no <= line_end);
+  return {source_->GetFileName(), buf_idx, line_no, col_no,
+	  std::string{buffer.substr(line_start, line_end - line_start)}};
 }
@@ -0,0 +1,36 @@
+// Define the byte string hash
+#include "utils/hash.hpp"
+#include <cstring>
+
+std::uint64_t HashBytes(const std::string_view bytes, const std::uint64_t seed) {
+  constexpr std::uint64_t kMul{0xc6a4a7935bd1e995ull};
+  constexpr int kShift{47};
+
+  const std::size_t length{bytes.length()};
+  const char* data{bytes.data()};
+  std::uint64_t hash{seed ^ (length * kMul)};
+
+  for (const char* const end{data + (length & ~std::size_t{7})}; data != end; data += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    word *= kMul;
+    word ^= word >> kShift;
+    word *= kMul;
+    hash ^= word;
+    hash *= kMul;
+  }
+
+  // The last length % 8 bytes
+  const std::size_t tail{length & 7};
+  if (tail) {
+    for (std::size_t i = tail; i > 0; --i) {
+      hash ^= static_cast<std::uint64_t>(static_cast<unsigned char>(data[i - 1])) << (8 * (i - 1));
+    }
+    hash *= kMul;
+  }
+
+  hash ^= hash >> kShift;
+  hash *= kMul;
+  hash ^= hash >> kShift;
+  return hash;
+}
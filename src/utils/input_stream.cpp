@@ -0,0 +1,56 @@
+// Implementation of the chunked input stream
+
+#include "utils/input_stream.hpp"
+#include "utils/source_buffer.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+
+InputStream::InputStream(const int fd, const std::string& file_name,
+                         const std::size_t chunk_size) :
+  fd_{fd},
+  file_name_{file_name},
+  chunk_size_{std::max<std::size_t>(chunk_size, 1)},
+  buffer_(1, SourceBuffer::kSentinel) {
+}
+
+bool InputStream::Refill(const std::uint64_t keep_from) {
+  assert (keep_from >= base_ && keep_from <= base_ + size_);
+
+  if (at_end_) { return false; }
+
+  // Move the kept bytes to the front of the buffer
+  const std::size_t kept{static_cast<std::size_t>(base_ + size_ - keep_from)};
+  std::memmove(buffer_.data(), buffer_.data() + (keep_from - base_), kept);
+  base_ = keep_from;
+  size_ = kept;
+
+  // Ask for at least as much as is kept, so a span that needs many refills
+  // is rescanned a logarithmic number of times
+  const std::size_t to_read{std::max(chunk_size_, kept)};
+  if (buffer_.size() < size_ + to_read + 1) {
+    buffer_.resize(size_ + to_read + 1);
+  }
+
+  // A pipe returns what it holds on each read - keep reading until to_read
+  // bytes have arrived, or the doubling above does not hold
+  std::size_t num_read{0};
+  while (num_read < to_read) {
+    const ssize_t n{read(fd_, buffer_.data() + size_ + num_read, to_read - num_read)};
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n < 0) {
+      spdlog::error("Cannot read {} - {}", file_name_, std::strerror(errno));
+    }
+    if (n <= 0) {
+      at_end_ = true;
+      break;
+    }
+    num_read += static_cast<std::size_t>(n);
+  }
+  size_ += num_read;
+  buffer_[size_] = SourceBuffer::kSentinel;
+  return num_read > 0;
+}
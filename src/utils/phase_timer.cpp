@@ -0,0 +1,43 @@
+// Define the phase timers
+#include "utils/phase_timer.hpp"
+#include <sys/resource.h>
+#include <time.h>
+
+static std::uint64_t ReadClock(const clockid_t clock) {
+  timespec now;
+  clock_gettime(clock, &now);
+  return static_cast<std::uint64_t>(now.tv_sec) * 1000000000u +
+         static_cast<std::uint64_t>(now.tv_nsec);
+}
+
+std::uint64_t GetWallNanos() {
+  return ReadClock(CLOCK_MONOTONIC);
+}
+
+std::uint64_t GetThreadCpuNanos() {
+  return ReadClock(CLOCK_THREAD_CPUTIME_ID);
+}
+
+ScopedPhaseTimer::ScopedPhaseTimer(PhaseTime* const total) :
+  total_{total},
+  wall_start_ns_{GetWallNanos()},
+  cpu_start_ns_{GetThreadCpuNanos()} {
+}
+
+ScopedPhaseTimer::~ScopedPhaseTimer() {
+  total_->cpu_ns += GetThreadCpuNanos() - cpu_start_ns_;
+  total_->wall_ns += GetWallNanos() - wall_start_ns_;
+}
+
+static std::uint64_t ToNanos(const timeval& time) {
+  return static_cast<std::uint64_t>(time.tv_sec) * 1000000000u +
+         static_cast<std::uint64_t>(time.tv_usec) * 1000u;
+}
+
+ProcessUsage GetProcessUsage() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  // ru_maxrss is in kilobytes on Linux
+  return {ToNanos(usage.ru_utime), ToNanos(usage.ru_stime),
+          static_cast<std::uint64_t>(usage.ru_maxrss) * 1024u};
+}
@@ -0,0 +1,124 @@
+// Implementation of the shared source buffer
+
+#include "utils/source_buffer.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::shared_ptr<const SourceBuffer> SourceBuffer::FromFile(const std::string& file_name) {
+  std::shared_ptr<SourceBuffer> buffer{new SourceBuffer};
+  buffer->file_name_ = file_name;
+
+  const int fd{open(file_name.c_str(), O_RDONLY)};
+  if (fd < 0) {
+    throw std::runtime_error(fmt::format("Cannot open {} - {}", file_name, std::strerror(errno)));
+  }
+
+  struct stat st;
+  const bool is_regular{fstat(fd, &st) == 0 && S_ISREG(st.st_mode)};
+  if (!is_regular || st.st_size == 0 || !buffer->Map(fd, st.st_size)) {
+    const int error{buffer->ReadAll(fd)};
+    if (error != 0) {
+      close(fd);
+      throw std::runtime_error(fmt::format("Cannot read {} - {}", file_name,
+                                           std::strerror(error)));
+    }
+  }
+  close(fd);
+
+  return buffer;
+}
+
+std::shared_ptr<const SourceBuffer> SourceBuffer::FromString(const std::string& file_name,
+                                                             const std::string_view contents) {
+  return FromStringEditable(file_name, contents);
+}
+
+std::shared_ptr<SourceBuffer> SourceBuffer::FromStringEditable(const std::string& file_name,
+                                                               const std::string_view contents) {
+  std::shared_ptr<SourceBuffer> buffer{new SourceBuffer};
+  buffer->file_name_ = file_name;
+  buffer->contents_.reserve(contents.size() + 1);
+  buffer->contents_.assign(contents.begin(), contents.end());
+  buffer->contents_.push_back(kSentinel);
+  buffer->data_ = buffer->contents_.data();
+  buffer->size_ = contents.size();
+  return buffer;
+}
+
+void SourceBuffer::Splice(const std::size_t offset, const std::size_t removed,
+                          const std::string_view inserted) {
+  assert (!mapping_);
+  assert (offset + removed <= size_);
+  // Overwrite what both have, then close or open the gap
+  const std::size_t num_common{std::min(removed, inserted.size())};
+  std::copy(inserted.begin(), inserted.begin() + num_common, contents_.begin() + offset);
+  if (removed > num_common) {
+    contents_.erase(contents_.begin() + offset + num_common, contents_.begin() + offset + removed);
+  } else {
+    contents_.insert(contents_.begin() + offset + num_common,
+                     inserted.begin() + num_common, inserted.end());
+  }
+  // The sentinel moved with the tail
+  data_ = contents_.data();
+  size_ = contents_.size() - 1;
+}
+
+SourceBuffer::~SourceBuffer() {
+  if (mapping_) {
+    munmap(mapping_, mapping_size_);
+  }
+}
+
+bool SourceBuffer::Map(const int fd, const std::size_t size) {
+  // Reserve zero-filled pages for the file plus the sentinel and map the file
+  // over the start of the reservation. The rest of the file's last page reads
+  // as zero, and so does the following page when the file ends on a page
+  // boundary - either way the sentinel is in place without a copy.
+  const std::size_t page_size{static_cast<std::size_t>(sysconf(_SC_PAGESIZE))};
+  const std::size_t mapping_size{(size + 1 + page_size - 1) / page_size * page_size};
+
+  void* const reservation{mmap(nullptr, mapping_size, PROT_READ,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)};
+  if (reservation == MAP_FAILED) { return false; }
+
+  void* const file_mapping{mmap(reservation, size, PROT_READ,
+                                MAP_PRIVATE | MAP_FIXED, fd, 0)};
+  if (file_mapping == MAP_FAILED) {
+    munmap(reservation, mapping_size);
+    return false;
+  }
+
+  mapping_ = reservation;
+  mapping_size_ = mapping_size;
+  data_ = static_cast<const char*>(mapping_);
+  size_ = size;
+  return true;
+}
+
+int SourceBuffer::ReadAll(const int fd) {
+  static constexpr std::size_t kReadChunk{1 << 16};
+
+  std::size_t size{0};
+  while (true) {
+    contents_.resize(size + kReadChunk);
+    const ssize_t n{read(fd, contents_.data() + size, kReadChunk)};
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n < 0) { return errno; }
+    if (n == 0) { break; }
+    size += n;
+  }
+
+  contents_.resize(size);
+  contents_.push_back(kSentinel);
+  data_ = contents_.data();
+  size_ = size;
+  return 0;
+}
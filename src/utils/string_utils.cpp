@@ -4,16 +4,17 @@
 #include <cctype>
 
 std::string Trim(const std::string& s) {
-  std::string trimmed = s;
-  while(trimmed.length() && std::isspace(trimmed.front())) {
-    trimmed.erase(trimmed.begin());
+  std::size_t begin{0};
+  std::size_t end{s.length()};
+  while (begin < end && std::isspace(static_cast<unsigned char>(s[begin]))) {
+    ++begin;
   }
 
-  while(trimmed.length() && std::isspace(trimmed.back())) {
-    trimmed.pop_back();
+  while (end > begin && std::isspace(static_cast<unsigned char>(s[end - 1]))) {
+    --end;
   }
 
-  return trimmed;
+  return s.substr(begin, end - begin);
 }
 
 std::vector<std::string> Split(const std::string& s, const char delim) {
@@ -0,0 +1,69 @@
+// Define the symbol table
+#include "utils/symbol_table.hpp"
+#include <algorithm>
+#include <cstring>
+#include "utils/hash.hpp"
+
+static constexpr std::size_t kInitialSlots{256};
+
+SymbolId SymbolTable::Intern(const std::string_view text) {
+  // Kept at most half full so that probe sequences stay short
+  if (2 * (symbols_.size() + 1) > slots_.size()) {
+    Grow();
+  }
+
+  const std::uint64_t hash{HashBytes(text)};
+  const std::size_t slot{Probe(text, hash)};
+  if (slots_[slot] != kNoSymbol) {
+    return slots_[slot];
+  }
+
+  const SymbolId id{static_cast<SymbolId>(symbols_.size())};
+  symbols_.emplace_back(Copy(text), text.length());
+  hashes_.push_back(hash);
+  slots_[slot] = id;
+  return id;
+}
+
+SymbolId SymbolTable::Find(const std::string_view text) const {
+  if (slots_.empty()) { return kNoSymbol; }
+  return slots_[Probe(text, HashBytes(text))];
+}
+
+std::size_t SymbolTable::Probe(const std::string_view text, const std::uint64_t hash) const {
+  const std::size_t mask{slots_.size() - 1};
+  for (std::size_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+    const SymbolId id{slots_[slot]};
+    if (id == kNoSymbol || (hashes_[id] == hash && symbols_[id] == text)) {
+      return slot;
+    }
+  }
+}
+
+const char* SymbolTable::Copy(const std::string_view text) {
+  if (text.length() > block_left_) {
+    // A string longer than a block gets a block of its own
+    const std::size_t size{std::max(kArenaBlockSize, text.length())};
+    arena_.emplace_back(new char[size]);
+    block_ = arena_.back().get();
+    block_left_ = size;
+    arena_bytes_ += size;
+  }
+  char* const copy{block_};
+  std::memcpy(copy, text.data(), text.length());
+  block_ += text.length();
+  block_left_ -= text.length();
+  return copy;
+}
+
+void SymbolTable::Grow() {
+  slots_.assign(slots_.empty() ? kInitialSlots : 2 * slots_.size(), kNoSymbol);
+  const std::size_t mask{slots_.size() - 1};
+  for (SymbolId id = 0; id < symbols_.size(); ++id) {
+    std::size_t slot{hashes_[id] & mask};
+    while (slots_[slot] != kNoSymbol) {
+      slot = (slot + 1) & mask;
+    }
+    slots_[slot] = id;
+  }
+}
@@ -0,0 +1,77 @@
+// Define the work-stealing thread pool
+#include "utils/thread_pool.hpp"
+#include <cassert>
+#include <exception>
+#include <thread>
+
+WorkStealingPool::WorkStealingPool(const std::size_t num_threads) :
+  num_threads_{num_threads ? num_threads : std::thread::hardware_concurrency()} {
+  // hardware_concurrency may not know
+  if (num_threads_ == 0) { num_threads_ = 1; }
+  for (std::size_t i = 0; i < num_threads_; ++i) {
+    queues_.emplace_back(new WorkerQueue);
+  }
+}
+
+void WorkStealingPool::Run(const std::size_t num_jobs,
+                           const std::function<void(std::size_t worker, std::size_t job)>& job) {
+  // The back of a queue is taken first - deal in reverse so that every
+  // worker starts with the lowest jobs
+  for (std::size_t i = num_jobs; i-- > 0;) {
+    queues_[i % num_threads_]->jobs.push_back(i);
+  }
+
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  auto work{[this, &job, &error_mutex, &error](const std::size_t worker) {
+    std::size_t next{0};
+    while (TakeJob(worker, &next)) {
+      try {
+        job(worker, next);
+      } catch (...) {
+        const std::lock_guard<std::mutex> lock{error_mutex};
+        if (!error) { error = std::current_exception(); }
+      }
+    }
+  }};
+
+  // The calling thread is worker 0
+  std::vector<std::thread> threads;
+  for (std::size_t worker = 1; worker < num_threads_ && worker < num_jobs; ++worker) {
+    threads.emplace_back(work, worker);
+  }
+  work(0);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+bool WorkStealingPool::TakeJob(const std::size_t worker, std::size_t* const job) {
+  assert (job);
+
+  {
+    WorkerQueue& own{*queues_[worker]};
+    const std::lock_guard<std::mutex> lock{own.mutex};
+    if (!own.jobs.empty()) {
+      *job = own.jobs.back();
+      own.jobs.pop_back();
+      return true;
+    }
+  }
+
+  // Steal the job the victim would take last
+  for (std::size_t i = 1; i < num_threads_; ++i) {
+    WorkerQueue& victim{*queues_[(worker + i) % num_threads_]};
+    const std::lock_guard<std::mutex> lock{victim.mutex};
+    if (!victim.jobs.empty()) {
+      *job = victim.jobs.front();
+      victim.jobs.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,21 @@
+// Define the run time gate of tracing and trace spans
+#include "utils/trace.hpp"
+
+// As spdlog, info and up until set otherwise
+std::atomic<int> Trace::level_{spdlog::level::info};
+
+void Trace::SetLevel(const spdlog::level::level_enum level) {
+  level_.store(level, std::memory_order_relaxed);
+  spdlog::set_level(level);
+}
+
+void TraceSpan::Begin(const char* const name) {
+  name_ = name;
+  start_ = std::chrono::steady_clock::now();
+  spdlog::debug("{} ...", name_);
+}
+
+void TraceSpan::End() {
+  spdlog::debug("{} done in {:.3f} ms", name_, std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start_).count());
+}
@@ -0,0 +1,201 @@
+// Benchmark the regex -> DFA construction phase by phase
+// Runs the DFA constructor over regex families parameterized by size and the
+// token regexes of a lexer definition file. For every regex it prints the
+// number of positions and states and, per construction phase, the wall time
+// and the peak heap usage reached during that phase.
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <lexer/dfa.hpp>
+#include <lexer/lexer_spec.hpp>
+#include <utils/trace.hpp>
+#include <spdlog/spdlog.h>
+#include <CLI/CLI11.hpp>
+
+// Heap accounting - every allocation carries a header with its size so that
+// the live byte count can be maintained on delete
+namespace {
+std::size_t g_live_bytes{0};
+std::size_t g_peak_bytes{0};
+constexpr std::size_t kAllocHeader{16};
+}
+
+void* operator new(std::size_t size) {
+  void* const p{std::malloc(size + kAllocHeader)};
+  if (!p) { throw std::bad_alloc(); }
+  *static_cast<std::size_t*>(p) = size;
+  g_live_bytes += size;
+  if (g_live_bytes > g_peak_bytes) { g_peak_bytes = g_live_bytes; }
+  return static_cast<char*>(p) + kAllocHeader;
+}
+
+void operator delete(void* p) noexcept {
+  if (!p) { return; }
+  void* const base{static_cast<char*>(p) - kAllocHeader};
+  g_live_bytes -= *static_cast<std::size_t*>(base);
+  std::free(base);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  operator delete(p);
+}
+
+struct DFABenchSettings {
+  std::string lexer_definition_file_name{"./lexer_regex.lex"};
+  int max_alternation{256};
+  int max_nested_stars{64};
+  int max_blowup{10};
+  int repeat{1};
+};
+
+struct PhaseMeasurement {
+  double millis{0.0};
+  std::size_t peak_bytes{0};
+};
+
+class PhaseTimer final : public DFAPhaseListener {
+public:
+  void OnPhaseStart(const DFAConstructionPhase phase) override {
+    (void)phase;
+    start_bytes_ = g_live_bytes;
+    g_peak_bytes = g_live_bytes;
+    start_ = std::chrono::steady_clock::now();
+  }
+
+  void OnPhaseEnd(const DFAConstructionPhase phase) override {
+    const auto end{std::chrono::steady_clock::now()};
+    auto& m{measurements_[phase]};
+    m.millis += std::chrono::duration<double, std::milli>(end - start_).count();
+    m.peak_bytes = std::max(m.peak_bytes, g_peak_bytes - start_bytes_);
+  }
+
+  const PhaseMeasurement& Get(const int phase) const { return measurements_[phase]; }
+
+private:
+  std::chrono::steady_clock::time_point start_;
+  std::size_t start_bytes_{0};
+  PhaseMeasurement measurements_[DFA_PHASE_COUNT];
+};
+
+static void PrintHeader() {
+  std::string header{fmt::format("{:<24} {:>6} {:>7} {:>7}", "regex", "n", "#pos", "#states")};
+  for (int phase = 0; phase < DFA_PHASE_COUNT; ++phase) {
+    header += fmt::format(" | {:>16}",
+                          DFAConstructionPhaseName(static_cast<DFAConstructionPhase>(phase)));
+  }
+  header += fmt::format(" | {:>10}", "total ms");
+  fmt::print("{}\n", header);
+  fmt::print("{:<48} ", "");
+  for (int phase = 0; phase < DFA_PHASE_COUNT; ++phase) {
+    fmt::print(" | {:>8} {:>7}", "ms", "peak KB");
+  }
+  fmt::print("\n");
+}
+
+static void Bench(const std::string& family, const std::string& n,
+                  const std::string& regex, const int repeat) {
+  PhaseTimer timer;
+  int num_states{0};
+  int num_positions{0};
+  for (int r = 0; r < repeat; ++r) {
+    const DFA dfa{regex, &timer};
+    num_states = dfa.GetNumStates();
+    num_positions = dfa.GetNumPositions();
+  }
+
+  std::string row{fmt::format("{:<24} {:>6} {:>7} {:>7}", family, n, num_positions, num_states)};
+  double total{0.0};
+  for (int phase = 0; phase < DFA_PHASE_COUNT; ++phase) {
+    const auto& m{timer.Get(phase)};
+    row += fmt::format(" | {:>8.3f} {:>7.1f}", m.millis / repeat, m.peak_bytes / 1024.0);
+    total += m.millis / repeat;
+  }
+  row += fmt::format(" | {:>10.3f}", total);
+  fmt::print("{}\n", row);
+}
+
+// (w0|w1|...|wn-1) - n distinct lower case words
+static std::string AlternationRegex(const int n) {
+  std::string regex{"("};
+  for (int i = 0; i < n; ++i) {
+    std::string word{"k"};
+    int x = i;
+    do {
+      word += static_cast<char>('a' + x % 26);
+      x /= 26;
+    } while (x);
+    regex += (i ? "|" : "") + word;
+  }
+  return regex + ")";
+}
+
+// ((((a)*)*)*)b - n nested stars
+static std::string NestedStarsRegex(const int n) {
+  std::string regex{"a"};
+  for (int i = 0; i < n; ++i) {
+    regex = fmt::format("({})*", regex);
+  }
+  return fmt::format("({})b", regex);
+}
+
+// ((a|b)*)a(a|b){n} - the DFA has 2^(n+1) states
+static std::string BlowupRegex(const int n) {
+  std::string regex{"((a|b)*)a"};
+  for (int i = 0; i < n; ++i) {
+    regex += "(a|b)";
+  }
+  return regex;
+}
+
+static void RunBenchmarks(const DFABenchSettings& settings) {
+  PrintHeader();
+
+  for (int n = 1; n <= settings.max_alternation; n *= 2) {
+    Bench("alternation", std::to_string(n), AlternationRegex(n), settings.repeat);
+  }
+
+  for (int n = 1; n <= settings.max_nested_stars; n *= 2) {
+    Bench("nested-stars", std::to_string(n), NestedStarsRegex(n), settings.repeat);
+  }
+
+  for (int n = 0; n <= settings.max_blowup; n += 2) {
+    Bench("(a|b)*a(a|b){n}", std::to_string(n), BlowupRegex(n), settings.repeat);
+  }
+
+  for (const auto& tr : ReadLexerDefinition(settings.lexer_definition_file_name).rules) {
+    Bench(tr.token, "-", tr.regex, settings.repeat);
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  fmt::print("peak rss {} KB\n", usage.ru_maxrss);
+}
+
+int main(int argc, char *argv[]) {
+
+#if defined(CCDEBUG)
+  Trace::SetLevel(spdlog::level::debug);
+#endif
+
+  DFABenchSettings settings;
+
+  CLI::App app{"dfa_bench - DFA construction benchmark"};
+  app.add_option("--lexer-definition-filename",
+                 settings.lexer_definition_file_name,
+                 "File defining tokens and regexes");
+  app.add_option("--max-alternation", settings.max_alternation,
+                 "Largest n-way alternation");
+  app.add_option("--max-nested-stars", settings.max_nested_stars,
+                 "Deepest star nesting");
+  app.add_option("--max-blowup", settings.max_blowup,
+                 "Largest n in (a|b)*a(a|b){n}");
+  app.add_option("--repeat", settings.repeat, "Constructions per regex");
+  CLI11_PARSE(app, argc, argv);
+
+  RunBenchmarks(settings);
+
+  return 0;
+}
@@ -4,6 +4,9 @@
 #include <string>
 #include <spdlog/spdlog.h>
 #include <lexer/dfa.hpp>
+#include <lexer/dfa_jit.hpp>
+#include <utils/byte_scan.hpp>
+#include <utils/trace.hpp>
 
 using namespace std;
 
@@ -65,6 +68,64 @@ const std::string COMMENT_BLOCK_END_REGEX{"\\*\\)"};
 const VECTOR_STRING COMMENT_BLOCK_END_PASS {"*)"};
 const VECTOR_STRING COMMENT_BLOCK_END_FAIL {" *)", "* )", "*) "};
 
+// Escaped parens inside a group and a class
+const std::string COMMENT_TEXT_REGEX{"((([^\\(\\*])(([^\\(\\*])*))|\\(|\\*)"};
+const VECTOR_STRING COMMENT_TEXT_PASS {"abc", "a)b", "(", "*"};
+const VECTOR_STRING COMMENT_TEXT_FAIL {"a(", "a*", "((", "**", ""};
+
+// The compiled automaton accepts the whole test string iff its longest match
+// spans the string, and it reads at least that far. Falls back to the DFA
+// itself when there is no JIT.
+bool JitTest(DFA& dfa, const std::string& test_str) {
+  if (!DFAJit::IsSupported()) { return dfa.Test(test_str); }
+  const DFAJit jit{{&dfa}};
+  int automaton_idx{-1};
+  std::size_t length{0};
+  std::size_t scan_length{0};
+  const bool matched{jit.Match(test_str.data(), test_str.data() + test_str.length(),
+                               &automaton_idx, &length, &scan_length)};
+  if (scan_length > test_str.length() || (matched && scan_length < length)) {
+    spdlog::error("JIT read {} bytes of {}", scan_length, test_str);
+  }
+  return matched && automaton_idx == 0 && length == test_str.length();
+}
+
+// The vector skip kernels agree with ByteClass::Contains wherever a run
+// ends in a chunk
+void byte_class_test() {
+  // A string body - whitespace and printable characters but quotes and backslashes
+  bool members[256]{};
+  for (int byte = 32; byte <= 126; ++byte) { members[byte] = true; }
+  for (const char byte : {'\t', '\n', '\v', '\f', '\r'}) { members[static_cast<unsigned char>(byte)] = true; }
+  members[static_cast<unsigned char>('"')] = false;
+  members[static_cast<unsigned char>('\\')] = false;
+
+  ByteClass byte_class;
+  if (!ByteClass::FromMembers(members, &byte_class)) {
+    spdlog::error("String body is not a ByteClass");
+    return;
+  }
+  for (int byte = 0; byte < 256; ++byte) {
+    if (byte_class.Contains(static_cast<unsigned char>(byte)) != members[byte]) {
+      spdlog::error("ByteClass disagrees on byte {}", byte);
+    }
+  }
+
+  std::string buffer(100, 'a');
+  for (const std::size_t stop : {std::size_t{1}, std::size_t{17}, std::size_t{40}, std::size_t{99}}) {
+    buffer[stop] = (stop % 2) ? '"' : static_cast<char>(0x80);
+  }
+  for (std::size_t pos = 0; pos <= buffer.length(); ++pos) {
+    std::size_t expected{pos};
+    while (expected < buffer.length() && members[static_cast<unsigned char>(buffer[expected])]) {
+      ++expected;
+    }
+    if (SkipByteClass(buffer, pos, byte_class) != expected) {
+      spdlog::error("SkipByteClass from {} should stop at {}", pos, expected);
+    }
+  }
+}
+
 void dfa_test() {
 
 #define TEST(regex, passes, fails)					  \
@@ -77,12 +138,18 @@ void dfa_test() {
       if (!test) {							  \
 	spdlog::error(fmt::format("{} dfa.Test({}) should pass but failed !", regex, tc)); \
       }									  \
+      if (!JitTest(dfa, tc)) {						  \
+	spdlog::error(fmt::format("{} jit match({}) should pass but failed !", regex, tc)); \
+      }									  \
     }									  \
     for (const auto& tc : fails) {					  \
       const auto test{dfa.Test(tc)};					  \
       if (test) {							  \
 	spdlog::error(fmt::format("{} dfa.Test({}) should fail but passed ", regex, tc));  \
       }									  \
+      if (JitTest(dfa, tc)) {						  \
+	spdlog::error(fmt::format("{} jit match({}) should fail but passed ", regex, tc));  \
+      }									  \
     }									  \
   }
 
@@ -97,6 +164,7 @@ void dfa_test() {
   TEST(COMMENT_LINE_REGEX, COMMENT_LINE_PASS, COMMEN_LINE_FAIL)
   TEST(COMMENT_BLOCK_START_REGEX, COMMENT_BLOCK_START_PASS, COMMENT_BLOCK_START_FAIL)
   TEST(COMMENT_BLOCK_END_REGEX, COMMENT_BLOCK_END_PASS, COMMENT_BLOCK_END_FAIL)
+  TEST(COMMENT_TEXT_REGEX, COMMENT_TEXT_PASS, COMMENT_TEXT_FAIL)
 
 #undef TEST
 }
@@ -104,13 +172,13 @@ void dfa_test() {
 int main() {
 
 #if defined(CCDEBUG)
-  spdlog::set_level(
-        static_cast<spdlog::level::level_enum>(spdlog::level::level_enum::debug));
+  Trace::SetLevel(spdlog::level::debug);
 #endif
 
   spdlog::debug("debug print ");
 
   dfa_test();
+  byte_class_test();
 
   return 0;
 }
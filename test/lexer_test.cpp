@@ -1,15 +1,29 @@
 // Run lexer of each of the input files
 // Have the ground truth lexer outputs in a directory
 // Compare the generated lexer output with the ground truth lexer output
+#include <algorithm>
+#include <cctype>
+#include <fcntl.h>
+#include <filesystem>
+#include <unistd.h>
 #include <vector>
 #include <string>
+#include <thread>
+#include <lexer/incremental_lexer.hpp>
 #include <lexer/lexer.hpp>
+#include <utils/buffered_writer.hpp>
 #include <utils/file_utils.hpp>
+#include <utils/input_stream.hpp>
+#include <utils/spsc_ring.hpp>
+#include <utils/thread_pool.hpp>
+#include <utils/trace.hpp>
 #include <spdlog/spdlog.h>
 #include <CLI/CLI11.hpp>
 
 struct LexerTestSettings {
   std::string lexer_definition_file_name;
+  bool lexer_jit{false};
+  bool lexer_pipeline{false};
 };
 
 struct TestFiles {
@@ -80,12 +94,43 @@ static const std::vector<TestFiles> kTestFiles{
    "./test-src/nested_comments.cl.cclex"}
 };
 
+// Render a token file in the text lex output format
+std::vector<std::string> TokenFileToLexLines(const std::string& token_file_name) {
+  std::vector<std::string> lines;
+  TokenFileReader reader{token_file_name};
+  TokenRecord record;
+  while (reader.Next(&record)) {
+    std::string name{reader.GetKindName(record.kind)};
+    std::transform(name.begin(), name.end(), name.begin(),
+                   [](const unsigned char c) { return std::tolower(c); });
+    lines.push_back(std::to_string(record.line_no + 1));
+    lines.push_back(name);
+    if (reader.KindHasLexeme(record.kind)) {
+      std::string_view lexeme{record.lexeme};
+      if (name == "string") {
+        lexeme = lexeme.substr(1, lexeme.length() - 2);
+      }
+      lines.emplace_back(lexeme);
+    }
+  }
+  return lines;
+}
+
 void RunTests(const LexerTestSettings& settings) {
 
+  // Every lexer shares one spec - the automatons are built once
+  const std::shared_ptr<const LexerSpec> spec{
+    LexerSpec::Load(settings.lexer_definition_file_name)};
+
   for (const auto& test : kTestFiles) {
-    spdlog::info("Testing {} ...", test.cool_program_file);
+    spdlog::info("Testing {} {}{}...", test.cool_program_file,
+                 settings.lexer_jit ? "(jit) " : "",
+                 settings.lexer_pipeline ? "(pipeline) " : "");
     // Run the lexer on the cool_program_file
-    Lexer lexer{settings.lexer_definition_file_name};
+    Lexer lexer{spec};
+    lexer.EnableJit(settings.lexer_jit);
+    lexer.EnableTokenFile(true);
+    lexer.EnablePipeline(settings.lexer_pipeline);
     lexer.RunLexerOn(test.cool_program_file);
 
     // Read lex output from coolcc (my implementation)
@@ -106,15 +151,725 @@ void RunTests(const LexerTestSettings& settings) {
 		       i, test_lex.at(i), groundtruth_lex.at(i));
       }
     }
+
+    // The token file holds the same tokens as the text output
+    const std::vector<std::string> token_file_lex{
+      TokenFileToLexLines(test.cool_program_file + ".cctok")};
+    if (token_file_lex != groundtruth_lex) {
+      spdlog::error("Token file of {} does not match the lex output", test.cool_program_file);
+    }
+
+    // The token buffer tiles the input - every token is a view of the
+    // source starting where the previous one ended
+    lexer.SetInputFile(test.cool_program_file);
+    TokenBuffer tokens;
+    lexer.Tokenize(&tokens);
+    const std::string source{ReadFile(test.cool_program_file)};
+    std::string tiled;
+    std::size_t line_no{0};
+    std::size_t line_start{0};
+    for (std::size_t i = 0; i < tokens.Size(); ++i) {
+      if (tokens.Offset(i) != tiled.length()) {
+	spdlog::error("Token {} @ {} does not follow the previous token", i, tokens.Offset(i));
+	break;
+      }
+      // Locations resolved on demand agree with counting lines in order
+      const FileLocationInfo info{lexer.GetFileLocationInfo(tokens.Offset(i))};
+      if (info.line_no != line_no || info.col_no != tokens.Offset(i) - line_start) {
+	spdlog::error("Token {} @ {} has location {}:{}", i, tokens.Offset(i),
+		      info.line_no, info.col_no);
+      }
+      tiled += tokens.Text(i, source);
+      for (std::size_t j = tokens.Offset(i); j < tiled.length(); ++j) {
+	if (tiled[j] == '\n') { ++line_no; line_start = j + 1; }
+      }
+    }
+    if (tiled != source) {
+      spdlog::error("Token buffer does not cover {}", test.cool_program_file);
+    }
+
+    // Batches add up to the same tokens
+    lexer.SetInputFile(test.cool_program_file);
+    TokenBuffer batch;
+    std::size_t num_batched{0};
+    while (lexer.NextBatch(&batch, 5)) {
+      for (std::size_t i = 0; i < batch.Size(); ++i, ++num_batched) {
+	if (num_batched >= tokens.Size() || batch.Get(i).offset != tokens.Offset(num_batched) ||
+	    batch.Kind(i) != tokens.Kind(num_batched)) {
+	  spdlog::error("Batched token {} differs", num_batched);
+	}
+      }
+    }
+    if (num_batched != tokens.Size()) {
+      spdlog::error("Batched {} tokens instead of {}", num_batched, tokens.Size());
+    }
+
+    // Keyword lookup picks the same tokens as the keyword automatons
+    lexer.EnableKeywordLookup(false);
+    lexer.SetInputFile(test.cool_program_file);
+    TokenBuffer scanned_tokens;
+    lexer.Tokenize(&scanned_tokens);
+    lexer.EnableKeywordLookup(true);
+    for (std::size_t i = 0; i < std::min(tokens.Size(), scanned_tokens.Size()); ++i) {
+      if (scanned_tokens.Kind(i) != tokens.Kind(i) || scanned_tokens.Length(i) != tokens.Length(i)) {
+	spdlog::error("Token {} @ {} differs without keyword lookup", i, tokens.Offset(i));
+	break;
+      }
+    }
+    if (scanned_tokens.Size() != tokens.Size()) {
+      spdlog::error("{} tokens without keyword lookup instead of {}",
+		    scanned_tokens.Size(), tokens.Size());
+    }
+
+    // Streaming in tiny chunks splits lexemes across refills and must not
+    // change the tokens
+    const int fd{open(test.cool_program_file.c_str(), O_RDONLY)};
+    lexer.SetInputStream(fd, test.cool_program_file, 7);
+    Token token;
+    std::size_t num_streamed{0};
+    while (lexer.GetNextToken(&token)) {
+      const std::size_t i{num_streamed++};
+      if (i >= tokens.Size() ||
+	  token.kind != tokens.Kind(i) ||
+	  lexer.GetTokenPosition(token) != tokens.Offset(i) ||
+	  (token.kind != kInvalidTokenKind && lexer.GetTokenText(token) != tokens.Text(i, source)) ||
+	  token.length != tokens.Length(i)) {
+	spdlog::error("Streamed token {} @ {} differs", i, lexer.GetTokenPosition(token));
+	break;
+      }
+    }
+    close(fd);
+    if (num_streamed != tokens.Size()) {
+      spdlog::error("Streamed {} tokens instead of {}", num_streamed, tokens.Size());
+    }
+
+    // Streamed batches end before the window moves - every token of a
+    // batch is still readable
+    const int batch_fd{open(test.cool_program_file.c_str(), O_RDONLY)};
+    lexer.SetInputStream(batch_fd, test.cool_program_file, 7);
+    num_streamed = 0;
+    while (lexer.NextBatch(&batch, 16)) {
+      for (std::size_t i = 0; i < batch.Size(); ++i, ++num_streamed) {
+	const Token streamed{batch.Get(i)};
+	if (num_streamed >= tokens.Size() ||
+	    lexer.GetTokenPosition(streamed) != tokens.Offset(num_streamed) ||
+	    (streamed.kind != kInvalidTokenKind &&
+	     lexer.GetTokenText(streamed) != tokens.Text(num_streamed, source))) {
+	  spdlog::error("Streamed batch token {} differs", num_streamed);
+	}
+      }
+    }
+    close(batch_fd);
+    if (num_streamed != tokens.Size()) {
+      spdlog::error("Streamed {} batched tokens instead of {}", num_streamed, tokens.Size());
+    }
+    lexer.Reset();
+
     spdlog::info("Test {} Passed ...", test.cool_program_file);
   }
 }
 
+// Lexers on several threads share one spec and its native code
+void TestParallelLexing(const LexerTestSettings& settings) {
+  const std::shared_ptr<const LexerSpec> spec{
+    LexerSpec::Load(settings.lexer_definition_file_name)};
+  WorkStealingPool pool{4};
+  std::vector<TokenBuffer> tokens(kTestFiles.size());
+  pool.Run(kTestFiles.size(), [&](const std::size_t, const std::size_t job) {
+    Lexer lexer{spec};
+    lexer.EnableJit(true);
+    lexer.SetInputFile(kTestFiles[job].cool_program_file);
+    lexer.Tokenize(&tokens[job]);
+  });
+
+  Lexer lexer{spec};
+  for (std::size_t i = 0; i < kTestFiles.size(); ++i) {
+    lexer.SetInputFile(kTestFiles[i].cool_program_file);
+    TokenBuffer expected;
+    lexer.Tokenize(&expected);
+    if (expected.Kinds() != tokens[i].Kinds() || expected.Offsets() != tokens[i].Offsets()) {
+      spdlog::error("Lexing {} on a pool changed its tokens", kTestFiles[i].cool_program_file);
+    }
+  }
+}
+
+// Values pushed through a small ring arrive in order, with the producer
+// held back while the ring is full
+void TestSpscRing() {
+  static constexpr int kNumValues{100000};
+  SpscRing<int> ring{4};
+  std::thread producer{[&ring]() {
+    for (int value = 0; value < kNumValues; ++value) {
+      ring.Push(value);
+    }
+    ring.Close();
+  }};
+
+  int expected{0};
+  int value{-1};
+  while (ring.Pop(&value)) {
+    if (value != expected++) {
+      spdlog::error("Ring popped {} instead of {}", value, expected - 1);
+      break;
+    }
+  }
+  producer.join();
+  if (expected != kNumValues) {
+    spdlog::error("Ring delivered {} values instead of {}", expected, kNumValues);
+  }
+}
+
+// Keywords ignore case, except that true and false start in lower case
+void TestKeywordCase(const LexerTestSettings& settings) {
+  static const std::vector<std::pair<std::string, std::string>> kCases{
+    {"class", "CLASS"}, {"Class", "CLASS"}, {"cLaSS", "CLASS"}, {"IF", "IF"},
+    {"iNhErItS", "INHERITS"}, {"true", "TRUE"}, {"tRUE", "TRUE"}, {"True", "TYPE"},
+    {"fALSE", "FALSE"}, {"False", "TYPE"}, {"ifx", "IDENTIFIER"}, {"Classy", "TYPE"}};
+
+  Lexer lexer{settings.lexer_definition_file_name};
+  for (const bool keyword_lookup : {false, true}) {
+    lexer.EnableKeywordLookup(keyword_lookup);
+    for (const auto& [text, kind] : kCases) {
+      lexer.SetInput(SourceBuffer::FromString("keywords", text));
+      Token token;
+      if (!lexer.GetNextToken(&token) || token.length != text.length() ||
+	  token.kind != lexer.GetTokenKinds().Find(kind)) {
+	spdlog::error("{} is not lexed as {}{}", text, kind,
+		      keyword_lookup ? " with keyword lookup" : "");
+      }
+    }
+  }
+}
+
+// A keyword that is not also an identifier keeps its automaton, so it is
+// still found with keyword lookup on
+void TestKeywordNotIdentifier() {
+  const std::string file_name{
+    (std::filesystem::temp_directory_path() / "lexer_test_keywords.lex").string()};
+  WriteToFile(file_name, "DEFINITIONS:\nIF : {if}\nARROW : {=>}\n"
+	      "IDENTIFIER : {[a-z]([a-z]*)}\nWS : {[W-S]([W-S]*)}\nKEYWORDS:\nIF\nARROW\n");
+  const std::shared_ptr<const LexerSpec> spec{std::make_shared<const LexerSpec>(file_name)};
+  std::filesystem::remove(file_name);
+  if (spec->GetModeRules(LexerSpec::kInitialMode, true) !=
+      spec->GetModeRules(LexerSpec::kInitialMode, false)) {
+    spdlog::error("Keyword lookup is on with a keyword that is not an identifier");
+  }
+
+  Lexer lexer{spec};
+  lexer.EnableKeywordLookup(true);
+  lexer.SetInput(SourceBuffer::FromString("keywords", "=> if"));
+  TokenBuffer tokens;
+  lexer.Tokenize(&tokens);
+  if (tokens.Size() != 3 || tokens.Kind(0) != lexer.GetTokenKinds().Find("ARROW") ||
+      tokens.Kind(2) != lexer.GetTokenKinds().Find("IF")) {
+    spdlog::error("Keywords are not lexed with a keyword that is not an identifier");
+  }
+}
+
+// Random edits that open and close comments and strings re-lex to the same
+// tokens as lexing the edited text from scratch
+void TestIncrementalLexing(const LexerTestSettings& settings) {
+  static const std::vector<std::string> kSnippets{
+    "(*", "*)", "\"", "--", "\n", " ", "x", "class", "12", "\\", "<-", "=>"};
+  static constexpr int kNumEdits{40};
+
+  const std::shared_ptr<const LexerSpec> spec{
+    LexerSpec::Load(settings.lexer_definition_file_name)};
+  IncrementalLexer incremental{spec};
+  Lexer lexer{spec};
+  // Deterministic so that a failure repeats
+  std::uint32_t seed{12345};
+  const auto next_random{[&seed](const std::size_t bound) {
+    seed = seed * 1664525u + 1013904223u;
+    return static_cast<std::size_t>(seed >> 8) % bound;
+  }};
+
+  for (const auto& test : kTestFiles) {
+    incremental.SetText(test.cool_program_file, ReadFile(test.cool_program_file));
+    for (int i = 0; i < kNumEdits; ++i) {
+      const std::string_view text{incremental.GetText()};
+      TextEdit edit;
+      edit.offset = next_random(text.size() + 1);
+      edit.removed = next_random(std::min<std::size_t>(text.size() - edit.offset, 8) + 1);
+      if (next_random(4) != 0) {
+        edit.inserted = kSnippets[next_random(kSnippets.size())];
+      }
+      incremental.ApplyEdit(edit);
+
+      lexer.SetInput(SourceBuffer::FromString(test.cool_program_file, incremental.GetText()));
+      TokenBuffer expected;
+      lexer.Tokenize(&expected);
+      // The shift of the offsets is left pending until the last edit
+      bool same{expected.Size() == incremental.GetNumTokens()};
+      for (std::size_t j = 0; same && j < expected.Size(); ++j) {
+	const Token token{incremental.GetToken(j)};
+	same = token.kind == expected.Kind(j) && token.offset == expected.Offset(j) &&
+	  token.length == expected.Length(j);
+      }
+      if (i + 1 == kNumEdits) {
+	const TokenBuffer& tokens{incremental.GetTokens()};
+	same = same && expected.Offsets() == tokens.Offsets();
+      }
+      if (!same) {
+	spdlog::error("Edit {} of {} at {} re-lexed to different tokens",
+		      i, test.cool_program_file, edit.offset);
+	break;
+      }
+    }
+  }
+}
+
+// A second run over unchanged files takes their tokens from the cache and
+// writes the same output; shrinking the cache evicts its entries
+void TestTokenCache(const LexerTestSettings& settings) {
+  const std::string directory{
+    (std::filesystem::temp_directory_path() / "lexer_test_token_cache").string()};
+  std::filesystem::remove_all(directory);
+
+  Lexer lexer{settings.lexer_definition_file_name};
+  {
+    const std::shared_ptr<TokenCache> cache{std::make_shared<TokenCache>(directory)};
+    lexer.SetTokenCache(cache);
+    for (const auto& test : kTestFiles) {
+      const LexerRunSummary lexed{lexer.RunLexerOn(test.cool_program_file)};
+      const std::string lexed_output{ReadFile(test.coolcc_lex_file)};
+      const LexerRunSummary cached{lexer.RunLexerOn(test.cool_program_file)};
+      if (lexed.cached || !cached.cached || cached.num_tokens != lexed.num_tokens ||
+	  ReadFile(test.coolcc_lex_file) != lexed_output) {
+	spdlog::error("Cached tokens of {} differ from lexing it", test.cool_program_file);
+      }
+    }
+    const TokenCacheStats stats{cache->GetStats()};
+    if (stats.hits != kTestFiles.size() || stats.misses != kTestFiles.size()) {
+      spdlog::error("Token cache had {} hits and {} misses for {} files",
+		    stats.hits, stats.misses, kTestFiles.size());
+    }
+
+    // Other contents under the same hash miss
+    const TokenCacheKey key{
+      TokenCache::Key(*lexer.GetSpec(), ReadFile(kTestFiles.front().cool_program_file))};
+    TokenBuffer tokens;
+    TokenCacheKey longer{key};
+    ++longer.source_bytes;
+    TokenCacheKey other{key};
+    ++other.check;
+    if (cache->Load(longer, &tokens) || cache->Load(other, &tokens) ||
+	!cache->Load(key, &tokens)) {
+      spdlog::error("Token cache entry is found by its hash alone");
+    }
+  }
+
+  const std::shared_ptr<TokenCache> small{std::make_shared<TokenCache>(directory, 1)};
+  lexer.SetTokenCache(small);
+  if (small->GetStats().evictions == 0 ||
+      lexer.RunLexerOn(kTestFiles.front().cool_program_file).cached) {
+    spdlog::error("Token cache over its size limit was not evicted");
+  }
+  lexer.SetTokenCache(nullptr);
+  std::filesystem::remove_all(directory);
+}
+
+// Equal lexemes get equal symbol ids from lexers sharing the tables, and
+// the ids name the lexemes
+void TestSymbolTables(const LexerTestSettings& settings) {
+  SymbolTable table;
+  std::vector<std::string> texts;
+  for (int i = 0; i < 5000; ++i) {
+    texts.push_back(fmt::format("name{}", i * 7919 % 5000));
+  }
+  texts.push_back(std::string(100000, 'x'));
+  texts.push_back("");
+  for (const std::string& text : texts) {
+    const SymbolId id{table.Intern(text)};
+    if (table.Get(id) != text || table.Find(text) != id || table.Intern(text) != id) {
+      spdlog::error("Symbol {} does not name {}", id, text.substr(0, 16));
+      break;
+    }
+  }
+  if (table.Size() != 5002 || table.Find("name5000") != kNoSymbol) {
+    spdlog::error("Symbol table holds {} symbols instead of 5002", table.Size());
+  }
+
+  const std::shared_ptr<const LexerSpec> spec{
+    LexerSpec::Load(settings.lexer_definition_file_name)};
+  const std::shared_ptr<SymbolTables> tables{std::make_shared<SymbolTables>()};
+  const TokenKind string_kind{spec->GetTokenKinds().Find("STRING")};
+  std::vector<TokenBuffer> tokens(kTestFiles.size());
+  std::vector<std::shared_ptr<const SourceBuffer>> sources(kTestFiles.size());
+  WorkStealingPool pool{2};
+  pool.Run(kTestFiles.size(), [&](const std::size_t, const std::size_t job) {
+    Lexer lexer{spec};
+    lexer.SetSymbolTables(tables);
+    sources[job] = SourceBuffer::FromFile(kTestFiles[job].cool_program_file);
+    lexer.SetInput(sources[job]);
+    lexer.Tokenize(&tokens[job]);
+  });
+
+  std::size_t num_symbols{0};
+  for (std::size_t file = 0; file < kTestFiles.size(); ++file) {
+    for (std::size_t i = 0; i < tokens[file].Size(); ++i) {
+      const SymbolId symbol{tokens[file].Symbol(i)};
+      if (symbol == kNoSymbol) { continue; }
+      ++num_symbols;
+      const TokenKind kind{tokens[file].Kind(i)};
+      std::string text{tokens[file].Text(i, sources[file]->View())};
+      const SymbolTable* table{&tables->idtable};
+      if (kind == string_kind) {
+	ScanStringLiteral(std::string{text}, &text);
+	table = &tables->stringtable;
+      } else if (spec->GetTokenKinds().Get(kind).name == "INTEGER") {
+	table = &tables->inttable;
+      }
+      if (table->Get(symbol) != text) {
+	spdlog::error("Token {} of {} has symbol {} instead of {}", i,
+		      kTestFiles[file].cool_program_file, table->Get(symbol), text);
+	return;
+      }
+    }
+  }
+  if (num_symbols == 0 || tables->idtable.Find("main") == kNoSymbol) {
+    spdlog::error("Lexing interned no symbols");
+  }
+}
+
+// Literals are decoded, and bad ones become error tokens with the messages
+// of the reference lexer, in files and in streams alike
+void TestLiterals(const LexerTestSettings& settings) {
+  const std::string file_name{
+    (std::filesystem::temp_directory_path() / "lexer_test_literals.cl").string()};
+  std::string source{"x <- \"tab\\there\\\nnext\";\n"
+                     "y <- \"open\nz <- 2147483647 + 2147483648;\n"
+                     "n <- \"a"};
+  source += '\0';
+  source += "b\";\nl <- \"" + std::string(kMaxStringLength + 1, 'x') + "\";\ne <- \"eof";
+  WriteToFile(file_name, source);
+
+  const std::shared_ptr<const LexerSpec> spec{
+    LexerSpec::Load(settings.lexer_definition_file_name)};
+  const TokenKindTable& kinds{spec->GetTokenKinds()};
+  const std::shared_ptr<SymbolTables> tables{std::make_shared<SymbolTables>()};
+  Lexer lexer{spec};
+  lexer.SetSymbolTables(tables);
+  lexer.SetInputFile(file_name);
+  TokenBuffer tokens;
+  lexer.Tokenize(&tokens);
+
+  std::vector<std::string> errors;
+  std::vector<std::string> strings;
+  std::vector<std::int32_t> integers;
+  for (std::size_t i = 0; i < tokens.Size(); ++i) {
+    const TokenKind kind{tokens.Kind(i)};
+    if (kind == kInvalidTokenKind) {
+      errors.push_back(GetLiteralErrorMessage(static_cast<LiteralError>(tokens.Symbol(i))));
+    } else if (kind == kinds.Find("STRING")) {
+      strings.emplace_back(tables->stringtable.Get(tokens.Symbol(i)));
+    } else if (kind == kinds.Find("INTEGER")) {
+      integers.push_back(tables->integers[tokens.Symbol(i)]);
+    }
+  }
+  const std::vector<std::string> expected_errors{
+    "Unterminated string constant", "Integer constant too large",
+    "String contains null character.", "String constant too long", "EOF in string constant"};
+  if (errors != expected_errors || strings != std::vector<std::string>{"tab\there\nnext"} ||
+      integers != std::vector<std::int32_t>{2147483647}) {
+    spdlog::error("Literals of {} are decoded wrong: {} errors, {} strings, {} integers",
+		  file_name, errors.size(), strings.size(), integers.size());
+  }
+
+  // Streamed in chunks shorter than the literals
+  const int fd{open(file_name.c_str(), O_RDONLY)};
+  lexer.SetInputStream(fd, file_name, 7);
+  Token token;
+  std::size_t num_streamed{0};
+  while (lexer.GetNextToken(&token)) {
+    const std::size_t i{num_streamed++};
+    if (i >= tokens.Size() || token.kind != tokens.Kind(i) || token.length != tokens.Length(i) ||
+	lexer.GetTokenPosition(token) != tokens.Offset(i) ||
+	(token.kind == kInvalidTokenKind && token.symbol != tokens.Symbol(i))) {
+      spdlog::error("Streamed literal token {} differs", i);
+      break;
+    }
+  }
+  close(fd);
+
+  // Error tokens are written where the literals end. The errors are
+  // expected, so they are not logged.
+  lexer.SetSymbolTables(nullptr);
+  const spdlog::level::level_enum level{spdlog::get_level()};
+  spdlog::set_level(spdlog::level::off);
+  const LexerRunSummary summary{lexer.RunLexerOn(file_name)};
+  spdlog::set_level(level);
+  const std::vector<std::string> output{ReadFileLines(file_name + ".cclex")};
+  const auto error_at{[&output](const std::string& line, const std::string& message) {
+    for (std::size_t i = 0; i + 2 < output.size(); ++i) {
+      if (output[i] == line && output[i + 1] == "error" && output[i + 2] == message) {
+	return true;
+      }
+    }
+    return false;
+  }};
+  if (summary.num_errors != expected_errors.size() ||
+      !error_at("3", "Unterminated string constant") ||
+      !error_at("7", "EOF in string constant")) {
+    spdlog::error("Lex output of {} misses literal errors", file_name);
+  }
+  std::filesystem::remove(file_name);
+  std::filesystem::remove(file_name + ".cclex");
+}
+
+// Unmatched input is one error token per run, whether the run is of bytes
+// no token starts with or of bytes that start tokens which do not match
+void TestErrorRecovery(const LexerTestSettings& settings) {
+  const std::string file_name{
+    (std::filesystem::temp_directory_path() / "lexer_test_errors.cl").string()};
+  std::string garbage;
+  for (int i = 0; i < 3000; ++i) {
+    garbage += static_cast<char>(0x80 + i % 0x80);
+  }
+  const std::string source{"class A { x : Int <- 1 !$% 2; };\n" + garbage +
+                           "\nx <- [!\"s\"]; y <- a#b;"};
+  WriteToFile(file_name, source);
+
+  Lexer lexer{settings.lexer_definition_file_name};
+  lexer.SetInputFile(file_name);
+  TokenBuffer tokens;
+  lexer.Tokenize(&tokens);
+  std::vector<std::string> runs;
+  for (std::size_t i = 0; i < tokens.Size(); ++i) {
+    if (tokens.Kind(i) == kInvalidTokenKind) {
+      runs.emplace_back(tokens.Text(i, source));
+    }
+  }
+  if (runs != std::vector<std::string>{"!$%", garbage, "[!", "]", "#"}) {
+    spdlog::error("Unmatched input of {} is in {} runs", file_name, runs.size());
+  }
+
+  // Runs longer than the window are streamed whole
+  const int fd{open(file_name.c_str(), O_RDONLY)};
+  lexer.SetInputStream(fd, file_name, 7);
+  Token token;
+  std::size_t num_streamed{0};
+  while (lexer.GetNextToken(&token)) {
+    const std::size_t i{num_streamed++};
+    if (i >= tokens.Size() || token.kind != tokens.Kind(i) || token.length != tokens.Length(i) ||
+	lexer.GetTokenPosition(token) != tokens.Offset(i)) {
+      spdlog::error("Streamed error token {} differs", i);
+      break;
+    }
+  }
+  close(fd);
+
+  const spdlog::level::level_enum level{spdlog::get_level()};
+  spdlog::set_level(spdlog::level::off);
+  const LexerRunSummary summary{lexer.RunLexerOn(file_name)};
+  spdlog::set_level(level);
+  const std::vector<std::string> output{ReadFileLines(file_name + ".cclex")};
+  if (summary.num_errors != runs.size() ||
+      std::count(output.begin(), output.end(), "error") != static_cast<long>(runs.size()) ||
+      std::find(output.begin(), output.end(), "!$%") == output.end()) {
+    spdlog::error("Lex output of {} has {} errors instead of {}", file_name,
+		  summary.num_errors, runs.size());
+  }
+  std::filesystem::remove(file_name);
+  std::filesystem::remove(file_name + ".cclex");
+}
+
+// Diagnostics are kept unformatted until rendered, sorted by location and
+// without repeats
+void TestDiagnostics(const LexerTestSettings& settings) {
+  const std::string file_name{
+    (std::filesystem::temp_directory_path() / "lexer_test_diagnostics.cl").string()};
+  WriteToFile(file_name, "x <- 1;\n  y <- #;\n*) (* open");
+
+  Lexer lexer{settings.lexer_definition_file_name};
+  const LexerRunSummary summary{lexer.RunLexerOn(file_name)};
+  const auto& diagnostics{summary.diagnostics};
+  if (!diagnostics || diagnostics->Size() != 3 || summary.num_errors != 3) {
+    spdlog::error("{} has {} diagnostics instead of 3", file_name,
+                  diagnostics ? diagnostics->Size() : 0);
+    return;
+  }
+  const Diagnostic& unmatched{diagnostics->GetDiagnostics().front()};
+  if (std::string{unmatched.kind->code} != "LEX001" || unmatched.line_no != 1 ||
+      unmatched.col_no != 7 || unmatched.length != 1) {
+    spdlog::error("Unmatched input of {} reported as {} at {}:{}", file_name,
+                  unmatched.kind->code, unmatched.line_no, unmatched.col_no);
+  }
+
+  // Reports out of order and repeated
+  const DiagnosticKind kind{"TEST001", Severity::WARNING, "value {} of {}"};
+  DiagnosticBuffer buffer{file_name, SourceBuffer::FromString(file_name, "ab\ncd\"e\n")};
+  buffer.Report(kind, 4, 1, 1, 1, 2, 3);
+  buffer.Report(kind, 0, 0, 0, 2, 1);
+  buffer.Report(kind, 4, 1, 1, 1, 2, 3);
+  buffer.Finish();
+  if (buffer.Size() != 2 || buffer.GetDiagnostics().front().offset != 0 ||
+      buffer.GetNumErrors() != 0) {
+    spdlog::error("Diagnostics are not sorted without repeats");
+  }
+  if (DiagnosticBuffer::FormatMessage(buffer.GetDiagnostics().back()) != "value 2 of 3") {
+    spdlog::error("Diagnostic message is {}",
+                  DiagnosticBuffer::FormatMessage(buffer.GetDiagnostics().back()));
+  }
+
+  const std::string rendered_file{file_name + ".diagnostics"};
+  {
+    BufferedWriter out{rendered_file};
+    if (buffer.Render(DiagnosticFormat::TEXT, 1, &out) != 1 ||
+        buffer.Render(DiagnosticFormat::JSON, 5, &out) != 2) {
+      spdlog::error("Diagnostics are rendered past the limit");
+    }
+  }
+  const std::vector<std::string> rendered{ReadFileLines(rendered_file)};
+  const std::string json{"{\"file\":\"" + file_name + "\",\"line\":2,\"column\":2,"
+                         "\"offset\":4,\"length\":1,\"severity\":\"warning\","
+                         "\"code\":\"TEST001\",\"message\":\"value 2 of 3\"}"};
+  if (rendered.size() != 5 ||
+      rendered[0] != file_name + ":1:1: warning: value 1 of 0 [TEST001]" ||
+      rendered[1] != "  ab" || rendered[2] != "  ^~" || rendered[4] != json) {
+    spdlog::error("Diagnostics of {} are rendered wrong", file_name);
+  }
+  std::filesystem::remove(rendered_file);
+  std::filesystem::remove(file_name);
+  std::filesystem::remove(file_name + ".cclex");
+}
+
+// RunLexerOn counts the tokens of each kind and times its phases
+void TestRunStats(const LexerTestSettings& settings) {
+  const std::string& file_name{kTestFiles.front().cool_program_file};
+  Lexer lexer{settings.lexer_definition_file_name};
+  lexer.SetInputFile(file_name);
+  TokenBuffer tokens;
+  lexer.Tokenize(&tokens);
+  std::vector<std::size_t> kind_counts(lexer.GetTokenKinds().Size(), 0);
+  for (const TokenKind kind : tokens.Kinds()) {
+    ++kind_counts[kind];
+  }
+
+  const LexerRunSummary summary{lexer.RunLexerOn(file_name)};
+  if (summary.kind_counts != kind_counts) {
+    spdlog::error("Token counts of {} differ from its tokens", file_name);
+  }
+  if (summary.lex_time.wall_ns == 0 || summary.write_time.wall_ns == 0) {
+    spdlog::error("Phases of {} are not timed", file_name);
+  }
+}
+
+// Trace arguments are evaluated only when their level is enabled
+void TestTracing() {
+  int num_evaluated{0};
+  const auto evaluate{[&num_evaluated]() { return ++num_evaluated; }};
+  CC_DEBUG("traced {}", evaluate());
+  CC_TRACE("traced {}", evaluate());
+  if (num_evaluated != 0) {
+    spdlog::error("Disabled trace evaluated its arguments");
+  }
+
+  const spdlog::level::level_enum level{spdlog::get_level()};
+  Trace::SetLevel(spdlog::level::debug);
+  {
+    CC_TRACE_SPAN("TestTracing");
+    CC_DEBUG("traced {}", evaluate());
+  }
+  Trace::SetLevel(level);
+  if (num_evaluated != 1) {
+    spdlog::error("Enabled trace evaluated its arguments {} times", num_evaluated);
+  }
+}
+
+// Write text to a pipe in small pieces from another thread; returns the
+// read end
+static int PipeInPieces(const std::string& text, std::thread* const writer) {
+  int fds[2];
+  if (pipe(fds) != 0) { return -1; }
+  *writer = std::thread{[text, fd = fds[1]]() {
+    for (std::size_t pos = 0; pos < text.length(); pos += 100) {
+      const std::string_view piece{std::string_view{text}.substr(pos, 100)};
+      if (write(fd, piece.data(), piece.length()) < 0) { break; }
+    }
+    close(fd);
+  }};
+  return fds[0];
+}
+
+// A long lexeme arriving through a pipe in small writes is read in windows
+// that at least double, and lexes as from a file
+void TestPipeStreaming(const LexerTestSettings& settings) {
+  const std::string source{"x <- \"" + std::string(200000, 's') + "\";\n-- " +
+                           std::string(300000, 'c') + "\ny <- 1;\n"};
+
+  std::thread writer;
+  int fd{PipeInPieces(source, &writer)};
+  InputStream stream{fd, "pipe", 1024};
+  std::size_t num_refills{0};
+  std::size_t last_size{0};
+  while (stream.Refill(stream.GetBase())) {
+    ++num_refills;
+    if (!stream.AtEnd() && stream.size() < 2 * last_size) {
+      spdlog::error("Pipe window grew from {} to {} bytes", last_size, stream.size());
+    }
+    last_size = stream.size();
+  }
+  writer.join();
+  close(fd);
+  if (last_size != source.length() || num_refills > 20) {
+    spdlog::error("Pipe read {} of {} bytes in {} refills", last_size, source.length(),
+                  num_refills);
+  }
+
+  const std::string file_name{
+    (std::filesystem::temp_directory_path() / "lexer_test_pipe.cl").string()};
+  WriteToFile(file_name, source);
+  Lexer lexer{settings.lexer_definition_file_name};
+  lexer.SetInputFile(file_name);
+  TokenBuffer tokens;
+  lexer.Tokenize(&tokens);
+
+  fd = PipeInPieces(source, &writer);
+  lexer.SetInputStream(fd, "pipe", 1024);
+  Token token;
+  std::size_t num_streamed{0};
+  while (lexer.GetNextToken(&token)) {
+    const std::size_t i{num_streamed++};
+    if (i >= tokens.Size() || token.kind != tokens.Kind(i) ||
+        token.length != tokens.Length(i) || lexer.GetTokenPosition(token) != tokens.Offset(i)) {
+      spdlog::error("Piped token {} differs", i);
+      break;
+    }
+  }
+  writer.join();
+  close(fd);
+  if (num_streamed != tokens.Size()) {
+    spdlog::error("Piped {} tokens instead of {}", num_streamed, tokens.Size());
+  }
+  std::filesystem::remove(file_name);
+}
+
+// A missing input fails the run without writing an output
+void TestMissingInput(const LexerTestSettings& settings) {
+  const std::string file_name{
+    (std::filesystem::temp_directory_path() / "lexer_test_missing.cl").string()};
+  std::filesystem::remove(file_name);
+  Lexer lexer{settings.lexer_definition_file_name};
+  bool failed{false};
+  try {
+    lexer.RunLexerOn(file_name);
+  } catch (const std::runtime_error&) {
+    failed = true;
+  }
+  if (!failed) {
+    spdlog::error("Lexing the missing {} did not fail", file_name);
+  }
+  if (std::filesystem::exists(file_name + ".cclex")) {
+    spdlog::error("Lexing the missing {} wrote an output", file_name);
+    std::filesystem::remove(file_name + ".cclex");
+  }
+}
+
 int main(int argc, char *argv[]) {
 
 #if defined(CCDEBUG)
-  spdlog::set_level(
-        static_cast<spdlog::level::level_enum>(spdlog::level::level_enum::debug));
+  Trace::SetLevel(spdlog::level::debug);
 #endif
 
   LexerTestSettings settings;
@@ -125,7 +880,27 @@ int main(int argc, char *argv[]) {
                  "File defining tokens and regexes");
   CLI11_PARSE(app, argc, argv);
 
+  // Table driven automatons, then the automatons compiled to native code,
+  // then lexing and writing on separate threads
+  RunTests(settings);
+  settings.lexer_jit = true;
+  RunTests(settings);
+  settings.lexer_pipeline = true;
   RunTests(settings);
+  TestKeywordCase(settings);
+  TestKeywordNotIdentifier();
+  TestSpscRing();
+  TestParallelLexing(settings);
+  TestIncrementalLexing(settings);
+  TestTokenCache(settings);
+  TestSymbolTables(settings);
+  TestLiterals(settings);
+  TestErrorRecovery(settings);
+  TestDiagnostics(settings);
+  TestTracing();
+  TestRunStats(settings);
+  TestPipeStreaming(settings);
+  TestMissingInput(settings);
 
   return 0;
 }